@@ -6,8 +6,29 @@
 #include <map>
 #include <set>
 
+#ifndef CHANNEL_HISTORY_LIMIT
+# define CHANNEL_HISTORY_LIMIT 100
+#endif
+
+#define CHANNEL_INVITE_ONLY 0x01
+#define CHANNEL_TOPIC_LOCK 0x02
+#define CHANNEL_MODERATED 0x04
+#define CHANNEL_NO_EXTERNAL 0x08
+#define CHANNEL_SECRET 0x10
+#define CHANNEL_PRIVATE 0x20
+
+#define MEMBER_OP 0x01
+#define MEMBER_VOICE 0x02
+
 class Client;
 
+struct HistoryEntry
+{
+	long long time;
+	std::string msgid;
+	std::string line;
+};
+
 class Channel
 {
 public:
@@ -17,11 +38,13 @@ public:
 	const std::string &getName() const;
 	const std::string &getTopic() const;
 	void setTopic(const std::string &topic);
+	long getTopicTime() const;
 
 	void addClient(Client *client);
 	void removeClient(Client *client);
 	bool hasClient(Client *client) const;
 	std::vector<Client *> getClients() const;
+	size_t getClientCount() const;
 
 	void addOperator(Client *client);
 	void removeOperator(Client *client);
@@ -29,9 +52,21 @@ public:
 	std::vector<Client *> getOperators() const;
 	bool hasOperators() const;
 	void promoteNextOperator();
+	unsigned char getMemberModes(Client *client) const;
+	void setMemberMode(Client *client, unsigned char mode, bool enabled);
+	std::string getMemberPrefix(Client *client, bool all = false) const;
+	bool canSend(Client *client) const;
+	void setAwayNotify(Client *client, bool enabled);
+	const std::set<Client *> &getAwayNotify() const;
 
 	void broadcast(const std::string &message, Client *sender = NULL);
+	void broadcast(const std::string &message, Client *sender, const std::string &tags);
 
+	unsigned char getModes() const;
+	bool hasMode(unsigned char mode) const;
+	void setMode(unsigned char mode, bool enabled);
+	void setModes(unsigned char modes);
+	std::string getModeString(bool withKey) const;
 	void setInviteOnly(bool inviteOnly);
 	bool isInviteOnly() const;
 	void setTopicRestricted(bool restricted);
@@ -44,25 +79,39 @@ public:
 	void addInvitation(const std::string &nickname);
 	void removeInvitation(const std::string &nickname);
 	bool isInvited(const std::string &nickname) const;
+	const std::set<std::string> &getInvitations() const;
 
 	void addBan(const std::string &mask);
 	void removeBan(const std::string &mask);
 	bool isBanned(const std::string &mask) const;
 	std::vector<std::string> getBanList() const;
 
+	void setHistoryLimit(size_t limit);
+	size_t getHistoryLimit() const;
+	void addHistory(long long time, const std::string &msgid, const std::string &line);
+	size_t getHistorySize() const;
+	const HistoryEntry &getHistoryEntry(size_t index) const;
+
 private:
 	std::string _name;
 	std::string _topic;
+	long _topicTime;
 	std::vector<Client *> _clients;
-	std::vector<Client *> _operators;
+	std::map<Client *, unsigned char> _members;
+	size_t _operators;
+	size_t _websockets;
+	std::set<Client *> _awayNotify;
 
-	bool _inviteOnly;
-	bool _topicRestricted;
+	unsigned char _modes;
 	std::string _key;
 	int _userLimit;
 	std::vector<std::string> _banList;
 
 	std::set<std::string> _invitedNicks;
+
+	std::vector<HistoryEntry> _history;
+	size_t _historyStart;
+	size_t _historyLimit;
 };
 
 #endif
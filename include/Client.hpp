@@ -2,8 +2,42 @@
 #define CLIENT_HPP
 
 #include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <sys/types.h>
 
 class Server;
+class Channel;
+class TlsSession;
+class WebSocket;
+
+#ifndef CLIENT_CORK_LIMIT
+# define CLIENT_CORK_LIMIT 16384
+#endif
+
+enum ClientCap
+{
+	CAP_MESSAGE_TAGS = 1 << 0,
+	CAP_SERVER_TIME = 1 << 1,
+	CAP_ECHO_MESSAGE = 1 << 2,
+	CAP_BATCH = 1 << 3,
+	CAP_AWAY_NOTIFY = 1 << 4
+};
+
+struct ListQuery
+{
+	bool active;
+	std::string cursor;
+	std::vector<std::string> masks;
+	std::vector<std::string> excludes;
+	size_t minUsers;
+	size_t maxUsers;
+	long topicAfter;
+	long topicBefore;
+
+	ListQuery();
+};
 
 class Client
 {
@@ -24,7 +58,40 @@ public:
 	void setAuthenticated(bool auth);
 	void setRegistered(bool reg);
 
+	bool hasCap(unsigned int cap) const;
+	unsigned int getCaps() const;
+	void setCaps(unsigned int caps);
+	bool isServer() const;
+	void setServer(bool server);
+	Client *getUplink() const;
+	void setUplink(Client *uplink);
+	long getNickTs() const;
+	void setNickTs(long ts);
+	const std::string &getOrigin() const;
+	void setOrigin(const std::string &origin);
+
+	const std::vector<Channel *> &getChannels() const;
+	void addChannel(Channel *channel);
+	void removeChannel(Channel *channel);
+
+	bool isOper() const;
+	void setOper(bool oper);
+	bool isAway() const;
+	const std::string &getAway() const;
+	void setAway(const std::string &message);
+	bool isCapNegotiating() const;
+	void setCapNegotiating(bool negotiating);
+
+	void sendTagged(const std::string &tags, const std::string &message);
+
 	void sendMessage(const std::string &message);
+	void sendRaw(const std::string &data);
+	bool isWebSocket() const;
+	bool hasPendingOutput() const;
+	bool hasCorkedOutput() const;
+	bool isBlocked() const;
+	size_t getPendingOutput() const;
+	void flush();
 
 private:
 	int _fd;
@@ -33,9 +100,36 @@ private:
 	std::string _realname;
 	bool _authenticated;
 	bool _registered;
+	unsigned int _caps;
+	bool _capNegotiating;
+	bool _oper;
+	bool _server;
+	Client *_uplink;
+	long _nickTs;
+	std::string _origin;
+	std::vector<Channel *> _channels;
+	std::map<std::string, std::string> _monitoring;
+	std::string _away;
+	std::map<std::string, long long> _awayReplied;
+	bool _callerid;
+	long long _calleridNotified;
+	std::set<std::string> _silence;
+	std::set<std::string> _silenceNicks;
+	std::map<std::string, std::string> _accepted;
 	std::string _buffer;
+	std::string _outbuf;
+	bool _blocked;
+
+	ListQuery _list;
+	int _listener;
+	size_t _sendq;
+	TlsSession *_tls;
+	WebSocket *_ws;
+
+	ssize_t transmit(const char *data, size_t length);
 
 	friend class Server;
+	friend class Simulation;
 };
 
 #endif
@@ -0,0 +1,58 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+#ifndef LISTEN_BACKLOG
+# define LISTEN_BACKLOG 128
+#endif
+
+#ifndef RECV_SIZE
+# define RECV_SIZE 512
+#endif
+
+#ifndef CORK_LATENCY
+# define CORK_LATENCY 2000
+#endif
+
+struct Config
+{
+	std::string path;
+
+	std::vector<std::string> listen;
+	int backlog;
+	size_t recvSize;
+	size_t clientSendq;
+	size_t linkSendq;
+	size_t corkLatency;
+
+	size_t historyLimit;
+	size_t monitorLimit;
+	size_t monitorTotal;
+	size_t whoLimit;
+
+	std::vector<std::string> motd;
+	std::map<std::string, std::string> opers;
+
+	std::string serverName;
+	std::string linkPassword;
+	std::vector<std::pair<std::string, int> > links;
+
+	std::string metricsSocket;
+	std::string tlsCertificate;
+	std::string tlsKey;
+	std::string snapshotPath;
+	int snapshotInterval;
+	std::string tracePath;
+	size_t fanoutThreads;
+
+	Config();
+
+	void applyEnvironment();
+	bool load(const std::string &file, std::string &error);
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef FANOUTPOOL_HPP
+#define FANOUTPOOL_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <pthread.h>
+
+#ifndef CHANNEL_FANOUT_THRESHOLD
+# define CHANNEL_FANOUT_THRESHOLD 256
+#endif
+
+class Client;
+
+struct FanoutTask
+{
+	Client *const *clients;
+	size_t count;
+	Client *sender;
+	const std::string *plain;
+	const std::string *tagged;
+	const std::string *timed;
+	const std::string *framedPlain;
+	const std::string *framedTagged;
+	const std::string *framedTimed;
+};
+
+class FanoutPool
+{
+public:
+	FanoutPool();
+	~FanoutPool();
+
+	void start(size_t workers);
+	void stop();
+	size_t size() const;
+
+	void run(const std::vector<FanoutTask> &tasks);
+
+	static void deliver(const FanoutTask &task);
+
+private:
+	FanoutPool(const FanoutPool &);
+	FanoutPool &operator=(const FanoutPool &);
+
+	static void *worker(void *arg);
+	bool runNext(bool wait);
+
+	pthread_mutex_t _mutex;
+	pthread_cond_t _work;
+	pthread_cond_t _done;
+	std::vector<pthread_t> _threads;
+	std::vector<FanoutTask> _tasks;
+	size_t _next;
+	size_t _pending;
+	bool _stopping;
+};
+
+extern FanoutPool g_fanout;
+
+#endif
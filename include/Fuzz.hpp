@@ -0,0 +1,24 @@
+#ifndef FUZZ_HPP
+#define FUZZ_HPP
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include "Simulation.hpp"
+
+#define FUZZ_MAX_INPUT 4096
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+inline void fuzzCheck(const Simulation &sim, const char *where)
+{
+	std::string error;
+	if (!sim.check(error))
+	{
+		std::fprintf(stderr, "%s: invariant violated: %s\n", where, error.c_str());
+		std::abort();
+	}
+}
+
+#endif
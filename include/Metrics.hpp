@@ -0,0 +1,56 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <map>
+#include <cstddef>
+
+#define METRICS_BUCKETS 22
+
+struct Histogram
+{
+	unsigned long long buckets[METRICS_BUCKETS];
+	unsigned long long sum;
+	unsigned long long count;
+
+	Histogram();
+	void record(unsigned long long usec);
+};
+
+class Metrics
+{
+public:
+	Metrics();
+
+	static unsigned long long nowUsec();
+
+	void recordCommand(const std::string &name, unsigned long long usec);
+	void recordLoop(unsigned long long usec);
+	void addBytesIn(size_t bytes);
+	void addBytesOut(size_t bytes);
+	void connectionOpened();
+	void connectionClosed();
+
+	const std::map<std::string, Histogram> &getCommands() const;
+	const Histogram &getLoop() const;
+	unsigned long long getBytesIn() const;
+	unsigned long long getBytesOut() const;
+	unsigned long long getConnectionsOpened() const;
+	unsigned long long getConnectionsClosed() const;
+	unsigned long long getStartTime() const;
+
+	std::string prometheus(size_t clients, size_t channels, size_t queued) const;
+
+private:
+	std::map<std::string, Histogram> _commands;
+	Histogram _loop;
+	unsigned long long _bytesIn;
+	unsigned long long _bytesOut;
+	unsigned long long _connectionsOpened;
+	unsigned long long _connectionsClosed;
+	unsigned long long _startTime;
+};
+
+extern Metrics g_metrics;
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef PLATFORM_HPP
+#define PLATFORM_HPP
+
+#include <cstddef>
+#include <sys/types.h>
+
+class Platform
+{
+public:
+	virtual ~Platform();
+
+	virtual ssize_t send(int fd, const char *data, size_t length);
+	virtual ssize_t recv(int fd, char *buffer, size_t length);
+	virtual void close(int fd);
+	virtual long long now();
+};
+
+extern Platform *g_platform;
+
+#endif
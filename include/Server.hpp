@@ -6,12 +6,104 @@
 #include <vector>
 #include <set>
 #include <sys/select.h>
+#include <pthread.h>
 #include <csignal>
+#include "UserTable.hpp"
+#include "Config.hpp"
+#include "Trace.hpp"
+
+#define CLIENT_SENDQ_LIMIT (1 << 20)
+#define LINK_SENDQ_LIMIT (64 << 20)
+#define LINK_RETRY_INTERVAL 30
+#define METRICS_IDLE_TIMEOUT 5000
+#define SNAPSHOT_REJOIN_GRACE 600
+#define LIST_QUEUE_LOW 8192
+#define LIST_BATCH 64
+#define LIST_SCAN 4096
+#define MODE_LINE_LIMIT 12
+#define MODE_LINE_LENGTH 400
+#define MESSAGE_TARGETS 4
+#define AWAY_LENGTH 200
+#define AWAY_REPLY_INTERVAL 60000
+#define AWAY_REPLY_TARGETS 16
+
+#ifndef MONITOR_LIMIT
+# define MONITOR_LIMIT 100
+#endif
+
+#ifndef MONITOR_TOTAL_LIMIT
+# define MONITOR_TOTAL_LIMIT 100000
+#endif
+
+#ifndef SILENCE_LIMIT
+# define SILENCE_LIMIT 32
+#endif
+
+#ifndef ACCEPT_LIMIT
+# define ACCEPT_LIMIT 32
+#endif
+
+#define CALLERID_NOTIFY_INTERVAL 60000
+
+#ifndef WHO_LIMIT
+# define WHO_LIMIT 500
+#endif
+
+#ifndef WHOWAS_LIMIT
+# define WHOWAS_LIMIT 1024
+#endif
 
 extern volatile sig_atomic_t g_stop;
+extern volatile sig_atomic_t g_upgrade;
+extern volatile sig_atomic_t g_rehash;
 
 class Client;
 class Channel;
+class SnapshotWriter;
+class SnapshotReader;
+struct ListQuery;
+
+struct Listener
+{
+	int fd;
+	std::string address;
+	bool trusted;
+	bool tls;
+	bool websocket;
+	size_t maxClients;
+	size_t sendq;
+	size_t clients;
+
+	Listener();
+};
+
+struct LinkAttempt
+{
+	std::string host;
+	int port;
+	std::string service;
+	pthread_t resolver;
+	int wake[2];
+	int status;
+	struct addrinfo *result;
+	struct addrinfo *next;
+	int fd;
+};
+
+struct MetricsConn
+{
+	std::string output;
+	long long opened;
+};
+
+struct WhowasEntry
+{
+	std::string nickname;
+	std::string username;
+	std::string realname;
+	std::string server;
+	long time;
+};
 
 class Server
 {
@@ -19,11 +111,47 @@ public:
 	Server(int port, const char *password);
 	~Server();
 	void run();
+	void resume(int channel_fd);
+	void setBinaryPath(const std::string &path);
+	void configure(Config *config);
+	bool rehash(std::string &error);
+	void setMetricsSocket(const std::string &path);
+	void addListener(const std::string &spec);
+	bool setTls(const std::string &certificate, const std::string &key);
+
+	void setSnapshot(const std::string &path, int interval);
+	void setTrace(const std::string &path);
+	bool saveSnapshot();
+	bool loadSnapshot();
+	void dropEmptyChannels();
+
+	static long long currentTimeMs();
+	static std::string formatServerTime(long long ms);
+	static bool parseServerTime(const std::string &text, long long &ms);
+	static bool clearStaleSocket(const std::string &path);
 
 private:
-	void handleNewConnection(int listen_fd);
+	void serve();
+	bool upgrade();
+	bool restoreUpgradeState(SnapshotReader &reader, const std::vector<int> &fds);
+
+	void openMetricsSocket();
+	void handleMetricsRequest(int fd);
+	void flushMetrics(int fd);
+	long long expireMetrics(long long now);
+	void closeFd(int fd);
+
+	static bool parseListener(const std::string &spec, Listener &listener);
+	bool openListener(Listener &listener);
+	bool openListeners();
+	void closeListeners(bool unlinkSockets);
+	Listener *findListener(int fd);
+	void handleNewConnection(Listener *listener);
+	Client *attachClient(int fd, Listener *listener);
 	void handleClientData(Client *client);
-	void removeClient(Client *client);
+	void receiveData(Client *client, std::string data);
+	void flushClients();
+	void removeClient(Client *client, const std::string &reason = "Connection closed");
 
 	void processCommand(Client *client, const std::string &command);
 
@@ -32,28 +160,94 @@ private:
 	void handleUser(Client *client, const std::vector<std::string> &args);
 
 	void handleJoin(Client *client, const std::vector<std::string> &args);
+	void joinChannel(Client *client, const std::string &channelName, const std::string &key);
+	void flushJoins();
 	void handlePart(Client *client, const std::vector<std::string> &args);
 	void handlePrivmsg(Client *client, const std::vector<std::string> &args);
 	void handleKick(Client *client, const std::vector<std::string> &args);
 	void handleInvite(Client *client, const std::vector<std::string> &args);
 	void handleTopic(Client *client, const std::vector<std::string> &args);
 	void handleMode(Client *client, const std::vector<std::string> &args);
+	void handleUserMode(Client *client, const std::vector<std::string> &args);
 
 	void handleQuit(Client *client, const std::vector<std::string> &args);
 	void handleCap(Client *client, const std::vector<std::string> &args);
 	void handlePing(Client *client, const std::vector<std::string> &args);
 	void handleNotice(Client *client, const std::vector<std::string> &args);
+	void deliverMessage(Client *client, const std::vector<std::string> &args, const std::string &command);
+	void handleAway(Client *client, const std::vector<std::string> &args);
+	void setAway(Client *client, const std::string &message);
+	void sendAwayReply(Client *client, Client *target);
+	void sendAwayJoin(Channel *channel, Client *client);
 	void handleWho(Client *client, const std::vector<std::string> &args);
+	void handleChathistory(Client *client, const std::vector<std::string> &args);
+	void handleTagmsg(Client *client, const std::vector<std::string> &args);
+	void handleOper(Client *client, const std::vector<std::string> &args);
+	void handleStats(Client *client, const std::vector<std::string> &args);
+	void handleServer(Client *client, const std::vector<std::string> &args);
+	void handleConnect(Client *client, const std::vector<std::string> &args);
+	void handleList(Client *client, const std::vector<std::string> &args);
+	bool continueLists();
+	static bool listMatches(const ListQuery &query, Channel *channel);
+	std::string whoReply(Client *client, const std::string &channel, Client *user, const std::string &prefix,
+	                     const std::string &fields, const std::string &token);
+	unsigned char userFlags(Client *client) const;
+	void handleWhois(Client *client, const std::vector<std::string> &args);
+	void handleWhowas(Client *client, const std::vector<std::string> &args);
+	void handleIson(Client *client, const std::vector<std::string> &args);
+	void recordWhowas(Client *client);
+	const std::string &originOf(Client *client) const;
+	static std::string foldNick(const std::string &nickname);
+	void handleMonitor(Client *client, const std::vector<std::string> &args);
+	void handleMotd(Client *client, const std::vector<std::string> &args);
+	void handleRehash(Client *client, const std::vector<std::string> &args);
+	void handleSilence(Client *client, const std::vector<std::string> &args);
+	void handleAccept(Client *client, const std::vector<std::string> &args);
+	bool acceptsPrivate(Client *target, Client *source, bool reply);
+	static std::string silenceNick(const std::string &mask);
+	void notifyMonitors(const std::string &nickname, Client *online);
+	void clearMonitors(Client *client);
+
+	bool connectLink(const std::string &host, int port);
+	static void *resolveLink(void *arg);
+	bool startLinkConnect(LinkAttempt *attempt);
+	void continueLinks(fd_set &write_fds);
+	void finishLink(LinkAttempt *attempt);
+	void retryAutoconnect();
+	void processLinkCommand(Client *link, const std::string &line);
+	void sendBurst(Client *link);
+	void splitLink(Client *link);
+	void introduceClient(Client *client);
+	void sendToLinks(const std::string &line, Client *except = NULL);
+	void sendToChannelLinks(Channel *channel, const std::string &line, Client *except = NULL);
+	void killClient(Client *client, const std::string &reason);
+	bool resolveCollision(Client *link, const std::string &nickname, long ts, Client *source);
+	void dropMember(Channel *channel, Client *client);
+	void applyLinkModes(Channel *channel, const std::vector<std::string> &args, size_t index);
+	Client *linkSource(Client *link, const std::string &source);
+	bool isLinkServer(Client *link, const std::string &source);
 
-	std::vector<std::string> splitCommand(const std::string &command);
+	void completeRegistration(Client *client);
+	std::string messageTags(long long &time, std::string &msgid);
+	std::string nextMsgid();
+	std::string nextBatchRef();
+
+	std::vector<std::string> splitCommand(const std::string &command, size_t offset = 0);
+	static bool matchMask(const std::string &mask, const std::string &value);
 	Client *findClientByNickname(const std::string &nickname);
 	Channel *findChannel(const std::string &name);
 	Channel *createChannel(const std::string &name);
 	void sendWelcome(Client *client);
 
+	static void writeChannelState(SnapshotWriter &writer, Channel *channel);
+	static bool readChannelState(SnapshotReader &reader, Channel *channel);
+
 	int _port;
 	std::string _password;
-	int _listen_fd;
+	const Config *_config;
+	std::vector<char> _recvBuffer;
+	std::vector<std::string> _listenSpecs;
+	std::vector<Listener> _listeners;
 
 	fd_set _master_set;
 	fd_set _read_fds;
@@ -62,6 +256,38 @@ private:
 	std::map<int, Client *> _clients;
 	std::map<std::string, Client *> _clients_by_nick;
 	std::map<std::string, Channel *> _channels;
+	std::map<std::string, std::vector<Client *> > _pendingJoins;
+
+	long long _startTime;
+	unsigned long _msgidSeq;
+	unsigned long _batchSeq;
+	std::string _clientTags;
+
+	std::string _snapshotPath;
+	int _snapshotInterval;
+	std::string _binaryPath;
+	TraceWriter _trace;
+
+	std::string _metricsPath;
+	int _metrics_fd;
+	std::map<int, MetricsConn> _metricsConns;
+
+	std::string _serverName;
+	std::map<std::string, Client *> _servers;
+	std::map<int, std::string> _linkPeers;
+	std::vector<LinkAttempt *> _linkAttempts;
+	long long _nextLinkRetry;
+
+	std::vector<WhowasEntry> _whowas;
+	size_t _whowasNext;
+	std::multimap<std::string, size_t> _whowasIndex;
+
+	UserTable _users;
+
+	std::map<std::string, std::set<Client *> > _watchers;
+	size_t _monitorTotal;
+
+	friend class Simulation;
 };
 
 #endif
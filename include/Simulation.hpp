@@ -0,0 +1,58 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "Platform.hpp"
+
+class Server;
+class Client;
+
+class Simulation : public Platform
+{
+public:
+	explicit Simulation(unsigned long seed);
+	~Simulation();
+
+	ssize_t send(int fd, const char *data, size_t length);
+	ssize_t recv(int fd, char *buffer, size_t length);
+	void close(int fd);
+	long long now();
+
+	int connect(bool websocket = false);
+	void input(int fd, const std::string &data);
+	void disconnect(int fd);
+	void tick(long long elapsedMs);
+	bool check(std::string &error) const;
+
+	bool isConnected(int fd) const;
+	Client *client(int fd) const;
+	size_t clients() const;
+	size_t channels() const;
+	unsigned long random();
+	std::vector<std::string> split(const std::string &line, size_t offset = 0) const;
+	static bool match(const std::string &mask, const std::string &value);
+
+	unsigned long long bytesOut() const;
+	unsigned long long sends() const;
+	unsigned long long digest() const;
+
+private:
+	Simulation(const Simulation &);
+	Simulation &operator=(const Simulation &);
+
+	Server *_server;
+	Platform *_previous;
+	std::map<int, std::string> _inbox;
+	std::set<int> _closing;
+	long long _clock;
+	int _nextFd;
+	unsigned long long _seed;
+	unsigned long long _bytesOut;
+	unsigned long long _sends;
+	unsigned long long _digest;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <string>
+#include <stdint.h>
+#include <cstddef>
+
+#define SNAPSHOT_MAGIC "IRCSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_HEADER_SIZE 24
+
+class SnapshotWriter
+{
+public:
+	SnapshotWriter();
+
+	void putU8(uint8_t value);
+	void putU32(uint32_t value);
+	void putI32(int32_t value);
+	void putU64(uint64_t value);
+	void putString(const std::string &value);
+
+	std::string finish(uint32_t version);
+
+private:
+	std::string _data;
+};
+
+class SnapshotReader
+{
+public:
+	SnapshotReader(const char *data, size_t size);
+
+	bool open(uint32_t version);
+	bool getU8(uint8_t &value);
+	bool getU32(uint32_t &value);
+	bool getI32(int32_t &value);
+	bool getU64(uint64_t &value);
+	bool getString(std::string &value);
+	bool atEnd() const;
+
+private:
+	const char *_data;
+	size_t _size;
+	size_t _pos;
+};
+
+uint32_t snapshotChecksum(const char *data, size_t size);
+
+#endif
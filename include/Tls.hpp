@@ -0,0 +1,41 @@
+#ifndef TLS_HPP
+#define TLS_HPP
+
+#include <string>
+#include <cstddef>
+#include <sys/types.h>
+
+struct ssl_st;
+
+class TlsSession
+{
+public:
+	static bool initialize(const std::string &certificate, const std::string &key);
+	static bool isAvailable();
+
+	explicit TlsSession(int fd);
+	~TlsSession();
+
+	bool isValid() const;
+	bool hasFailed() const;
+	bool wantsRead() const;
+	bool wantsWrite() const;
+	bool isKernelOffloaded() const;
+
+	ssize_t read(char *buffer, size_t length);
+	ssize_t write(const char *data, size_t length);
+	void handshake();
+
+private:
+	TlsSession(const TlsSession &);
+	TlsSession &operator=(const TlsSession &);
+
+	int update(int result, bool writing);
+
+	ssl_st *_ssl;
+	bool _wantRead;
+	bool _wantWrite;
+	bool _failed;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <stdint.h>
+#include <cstddef>
+
+#define TRACE_MAGIC "IRCTRACE"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 17
+#define TRACE_BUFFER 65536
+#define TRACE_FLUSH_INTERVAL 1000
+
+enum TraceEvent
+{
+	TRACE_OPEN = 1,
+	TRACE_LINE = 2,
+	TRACE_CLOSE = 3
+};
+
+struct TraceRecord
+{
+	uint8_t event;
+	uint32_t connection;
+	long long time;
+	std::string line;
+};
+
+class TraceWriter
+{
+public:
+	TraceWriter();
+	~TraceWriter();
+
+	bool open(const std::string &path, long long now);
+	void close();
+	bool isOpen() const;
+	const std::string &path() const;
+
+	void record(uint8_t event, int connection, long long time, const std::string &line = "");
+	void flush(long long now);
+
+private:
+	TraceWriter(const TraceWriter &);
+	TraceWriter &operator=(const TraceWriter &);
+
+	void putVarint(uint64_t value);
+	void write();
+
+	int _fd;
+	std::string _path;
+	std::string _buffer;
+	long long _last;
+	long long _flushed;
+};
+
+class TraceReader
+{
+public:
+	TraceReader();
+
+	bool open(const std::string &path, std::string &error);
+	bool next(TraceRecord &record);
+	bool failed() const;
+
+private:
+	bool getVarint(uint64_t &value);
+	bool readHeader();
+
+	std::string _data;
+	size_t _pos;
+	long long _last;
+	bool _failed;
+};
+
+#endif
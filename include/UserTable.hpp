@@ -0,0 +1,44 @@
+#ifndef USERTABLE_HPP
+#define USERTABLE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+class Client;
+
+enum UserFlag
+{
+	USER_OPER = 1 << 0,
+	USER_REMOTE = 1 << 1
+};
+
+class UserTable
+{
+public:
+	void insert(Client *client, const std::string &folded, unsigned char flags);
+	void rename(Client *client, const std::string &folded);
+	void setFlags(Client *client, unsigned char flags);
+	void remove(Client *client);
+	void clear();
+
+	size_t size() const;
+	Client *client(size_t row) const;
+	const std::string &nick(size_t row) const;
+	const std::string &user(size_t row) const;
+	const std::string &host(size_t row) const;
+	const std::string &realname(size_t row) const;
+	unsigned char flags(size_t row) const;
+
+private:
+	std::vector<Client *> _clients;
+	std::vector<std::string> _nicks;
+	std::vector<std::string> _users;
+	std::vector<std::string> _hosts;
+	std::vector<std::string> _realnames;
+	std::vector<unsigned char> _flags;
+	std::map<Client *, size_t> _rows;
+};
+
+#endif
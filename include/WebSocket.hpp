@@ -0,0 +1,45 @@
+#ifndef WEBSOCKET_HPP
+#define WEBSOCKET_HPP
+
+#include <string>
+#include <cstddef>
+
+#ifndef WEBSOCKET_HANDSHAKE_LIMIT
+# define WEBSOCKET_HANDSHAKE_LIMIT 8192
+#endif
+
+#ifndef WEBSOCKET_MESSAGE_LIMIT
+# define WEBSOCKET_MESSAGE_LIMIT 8192
+#endif
+
+class SnapshotWriter;
+class SnapshotReader;
+
+class WebSocket
+{
+public:
+	WebSocket();
+
+	bool isOpen() const;
+	bool receive(const std::string &data, std::string &lines, std::string &reply);
+
+	static std::string frame(const std::string &message);
+	static std::string closeFrame(unsigned short code);
+
+	void save(SnapshotWriter &writer) const;
+	bool restore(SnapshotReader &reader);
+
+private:
+	bool upgrade(std::string &reply);
+	bool decode(std::string &lines, std::string &reply);
+
+	static std::string header(unsigned char opcode, size_t length);
+	static std::string accept(const std::string &key);
+
+	bool _open;
+	bool _fragmented;
+	std::string _input;
+	std::string _message;
+};
+
+#endif
@@ -1,10 +1,15 @@
 #include "Channel.hpp"
 #include "Client.hpp"
+#include "FanoutPool.hpp"
+#include "WebSocket.hpp"
+#include "Platform.hpp"
 #include <algorithm>
 #include <iostream>
+#include <sstream>
 
 Channel::Channel(const std::string &name)
-	: _name(name), _inviteOnly(false), _topicRestricted(false), _userLimit(0)
+	: _name(name), _topicTime(0), _operators(0), _websockets(0), _modes(0), _userLimit(0),
+	  _historyStart(0), _historyLimit(CHANNEL_HISTORY_LIMIT)
 {
 }
 
@@ -25,6 +30,12 @@ const std::string &Channel::getTopic() const
 void Channel::setTopic(const std::string &topic)
 {
 	_topic = topic;
+	_topicTime = g_platform->now() / 1000;
+}
+
+long Channel::getTopicTime() const
+{
+	return _topicTime;
 }
 
 void Channel::addClient(Client *client)
@@ -32,21 +43,35 @@ void Channel::addClient(Client *client)
 	if (client && !hasClient(client))
 	{
 		_clients.push_back(client);
+		_members[client] = 0;
+		client->addChannel(this);
+		if (client->isWebSocket())
+			++_websockets;
+		if (client->hasCap(CAP_AWAY_NOTIFY))
+			_awayNotify.insert(client);
 	}
 }
 
 void Channel::removeClient(Client *client)
 {
-	if (client)
+	if (client && hasClient(client))
 	{
 		_clients.erase(std::remove(_clients.begin(), _clients.end(), client), _clients.end());
+		if (client->isWebSocket())
+			--_websockets;
 		removeOperator(client);
+		_members.erase(client);
+		_awayNotify.erase(client);
+		client->removeChannel(this);
 	}
 }
 
 bool Channel::hasClient(Client *client) const
 {
-	return std::find(_clients.begin(), _clients.end(), client) != _clients.end();
+	if (!client)
+		return false;
+	const std::vector<Channel *> &channels = client->getChannels();
+	return std::find(channels.begin(), channels.end(), this) != channels.end();
 }
 
 std::vector<Client *> Channel::getClients() const
@@ -54,66 +79,225 @@ std::vector<Client *> Channel::getClients() const
 	return _clients;
 }
 
+size_t Channel::getClientCount() const
+{
+	return _members.size();
+}
+
 void Channel::addOperator(Client *client)
 {
-	if (client && !isOperator(client))
-	{
-		_operators.push_back(client);
-	}
+	setMemberMode(client, MEMBER_OP, true);
 }
 
 void Channel::removeOperator(Client *client)
 {
-	if (client)
-	{
-		_operators.erase(std::remove(_operators.begin(), _operators.end(), client), _operators.end());
-	}
+	setMemberMode(client, MEMBER_OP, false);
 }
 
 bool Channel::isOperator(Client *client) const
 {
-	return std::find(_operators.begin(), _operators.end(), client) != _operators.end();
+	return getMemberModes(client) & MEMBER_OP;
 }
 
 std::vector<Client *> Channel::getOperators() const
 {
-	return _operators;
+	std::vector<Client *> operators;
+	for (std::vector<Client *>::const_iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		if (isOperator(*it))
+			operators.push_back(*it);
+	}
+	return operators;
 }
 
 bool Channel::hasOperators() const
 {
-	return !_operators.empty();
+	return _operators > 0;
+}
+
+unsigned char Channel::getMemberModes(Client *client) const
+{
+	std::map<Client *, unsigned char>::const_iterator it = _members.find(client);
+	return it == _members.end() ? 0 : it->second;
+}
+
+void Channel::setMemberMode(Client *client, unsigned char mode, bool enabled)
+{
+	std::map<Client *, unsigned char>::iterator it = _members.find(client);
+	if (it == _members.end())
+		return;
+	unsigned char modes = enabled ? (it->second | mode) : (it->second & ~mode);
+	if ((modes & MEMBER_OP) && !(it->second & MEMBER_OP))
+		++_operators;
+	else if (!(modes & MEMBER_OP) && (it->second & MEMBER_OP))
+		--_operators;
+	it->second = modes;
+}
+
+std::string Channel::getMemberPrefix(Client *client, bool all) const
+{
+	unsigned char modes = getMemberModes(client);
+	std::string prefix;
+	if (modes & MEMBER_OP)
+		prefix += "@";
+	if ((modes & MEMBER_VOICE) && (all || prefix.empty()))
+		prefix += "+";
+	return prefix;
 }
 
 void Channel::broadcast(const std::string &message, Client *sender)
 {
-	for (std::vector<Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	broadcast(message, sender, "");
+}
+
+void Channel::broadcast(const std::string &message, Client *sender, const std::string &tags)
+{
+	std::string tagged;
+	std::string timed;
+	if (!tags.empty())
+	{
+		tagged = "@" + tags + " " + message;
+		timed = "@" + tags.substr(0, tags.find(';')) + " " + message;
+	}
+
+	FanoutTask task;
+	task.clients = _clients.empty() ? NULL : &_clients[0];
+	task.count = _clients.size();
+	task.sender = sender;
+	task.plain = &message;
+	task.tagged = tags.empty() ? NULL : &tagged;
+	task.timed = tags.empty() ? NULL : &timed;
+
+	std::string framedPlain;
+	std::string framedTagged;
+	std::string framedTimed;
+	task.framedPlain = NULL;
+	task.framedTagged = NULL;
+	task.framedTimed = NULL;
+	if (_websockets)
 	{
-		if (*it != sender)
+		framedPlain = WebSocket::frame(message);
+		task.framedPlain = &framedPlain;
+		if (!tags.empty())
 		{
-			(*it)->sendMessage(message);
+			framedTagged = WebSocket::frame(tagged);
+			framedTimed = WebSocket::frame(timed);
+			task.framedTagged = &framedTagged;
+			task.framedTimed = &framedTimed;
 		}
 	}
+
+	size_t workers = g_fanout.size();
+	if (workers == 0 || task.count < CHANNEL_FANOUT_THRESHOLD)
+	{
+		FanoutPool::deliver(task);
+		return;
+	}
+
+	size_t chunk = (task.count + workers) / (workers + 1);
+	std::vector<FanoutTask> tasks;
+	for (size_t offset = 0; offset < _clients.size(); offset += chunk)
+	{
+		task.clients = &_clients[offset];
+		task.count = std::min(chunk, _clients.size() - offset);
+		tasks.push_back(task);
+	}
+	g_fanout.run(tasks);
+}
+
+bool Channel::canSend(Client *client) const
+{
+	if (!(_modes & (CHANNEL_NO_EXTERNAL | CHANNEL_MODERATED)))
+		return true;
+	std::map<Client *, unsigned char>::const_iterator it = _members.find(client);
+	if (it == _members.end())
+		return false;
+	return !(_modes & CHANNEL_MODERATED) || (it->second & (MEMBER_OP | MEMBER_VOICE));
+}
+
+void Channel::setAwayNotify(Client *client, bool enabled)
+{
+	if (!hasClient(client))
+		return;
+	if (enabled)
+		_awayNotify.insert(client);
+	else
+		_awayNotify.erase(client);
+}
+
+const std::set<Client *> &Channel::getAwayNotify() const
+{
+	return _awayNotify;
+}
+
+unsigned char Channel::getModes() const
+{
+	return _modes;
+}
+
+bool Channel::hasMode(unsigned char mode) const
+{
+	return _modes & mode;
+}
+
+void Channel::setMode(unsigned char mode, bool enabled)
+{
+	_modes = enabled ? (_modes | mode) : (_modes & ~mode);
+}
+
+void Channel::setModes(unsigned char modes)
+{
+	_modes = modes;
+}
+
+std::string Channel::getModeString(bool withKey) const
+{
+	static const char letters[] = "imnpst";
+	static const unsigned char flags[] = {
+		CHANNEL_INVITE_ONLY, CHANNEL_MODERATED, CHANNEL_NO_EXTERNAL,
+		CHANNEL_PRIVATE, CHANNEL_SECRET, CHANNEL_TOPIC_LOCK
+	};
+	std::string modes = "+";
+	std::string params;
+	for (size_t i = 0; i < sizeof(flags); ++i)
+	{
+		if (_modes & flags[i])
+			modes += letters[i];
+	}
+	if (!_key.empty())
+	{
+		modes += "k";
+		if (withKey)
+			params += " " + _key;
+	}
+	if (_userLimit > 0)
+	{
+		std::ostringstream oss;
+		oss << _userLimit;
+		modes += "l";
+		params += " " + oss.str();
+	}
+	return modes + params;
 }
 
 void Channel::setInviteOnly(bool inviteOnly)
 {
-	_inviteOnly = inviteOnly;
+	setMode(CHANNEL_INVITE_ONLY, inviteOnly);
 }
 
 bool Channel::isInviteOnly() const
 {
-	return _inviteOnly;
+	return hasMode(CHANNEL_INVITE_ONLY);
 }
 
 void Channel::setTopicRestricted(bool restricted)
 {
-	_topicRestricted = restricted;
+	setMode(CHANNEL_TOPIC_LOCK, restricted);
 }
 
 bool Channel::isTopicRestricted() const
 {
-	return _topicRestricted;
+	return hasMode(CHANNEL_TOPIC_LOCK);
 }
 
 void Channel::setKey(const std::string &key)
@@ -161,7 +345,7 @@ std::vector<std::string> Channel::getBanList() const
 
 void Channel::promoteNextOperator()
 {
-	if (_operators.empty() && !_clients.empty())
+	if (_operators == 0 && !_clients.empty())
 	{
 		Client *newOp = _clients[0];
 		addOperator(newOp);
@@ -185,3 +369,62 @@ bool Channel::isInvited(const std::string &nickname) const
 {
 	return _invitedNicks.find(nickname) != _invitedNicks.end();
 }
+
+const std::set<std::string> &Channel::getInvitations() const
+{
+	return _invitedNicks;
+}
+
+void Channel::setHistoryLimit(size_t limit)
+{
+	if (limit == _historyLimit)
+		return;
+
+	std::vector<HistoryEntry> kept;
+	size_t size = getHistorySize();
+	size_t skip = (size > limit) ? size - limit : 0;
+	for (size_t i = skip; i < size; ++i)
+	{
+		kept.push_back(getHistoryEntry(i));
+	}
+	_history.swap(kept);
+	_historyStart = 0;
+	_historyLimit = limit;
+}
+
+size_t Channel::getHistoryLimit() const
+{
+	return _historyLimit;
+}
+
+void Channel::addHistory(long long time, const std::string &msgid, const std::string &line)
+{
+	if (_historyLimit == 0)
+		return;
+
+	if (_history.size() < _historyLimit)
+	{
+		HistoryEntry entry;
+		entry.time = time;
+		entry.msgid = msgid;
+		entry.line = line;
+		_history.push_back(entry);
+		return;
+	}
+
+	HistoryEntry &slot = _history[_historyStart];
+	slot.time = time;
+	slot.msgid = msgid;
+	slot.line = line;
+	_historyStart = (_historyStart + 1) % _history.size();
+}
+
+size_t Channel::getHistorySize() const
+{
+	return _history.size();
+}
+
+const HistoryEntry &Channel::getHistoryEntry(size_t index) const
+{
+	return _history[(_historyStart + index) % _history.size()];
+}
@@ -1,16 +1,30 @@
 #include "Client.hpp"
+#include "Metrics.hpp"
+#include "Platform.hpp"
+#include "Tls.hpp"
+#include "WebSocket.hpp"
 #include <sys/socket.h>
 #include <unistd.h>
 #include <iostream>
+#include <algorithm>
 
-Client::Client(int fd) : _fd(fd), _authenticated(false), _registered(false)
+ListQuery::ListQuery()
+	: active(false), minUsers(0), maxUsers(static_cast<size_t>(-1)), topicAfter(0), topicBefore(0)
+{
+}
+
+Client::Client(int fd) : _fd(fd), _authenticated(false), _registered(false),
+	  _caps(0), _capNegotiating(false), _oper(false),
+	  _server(false), _uplink(NULL), _nickTs(0), _callerid(false), _calleridNotified(0), _blocked(false), _listener(-1), _sendq(0), _tls(NULL), _ws(NULL)
 {
 }
 
 Client::~Client()
 {
+	delete _ws;
+	delete _tls;
 	if (_fd >= 0)
-		close(_fd);
+		g_platform->close(_fd);
 }
 
 int Client::getFd() const
@@ -68,10 +82,186 @@ void Client::setRegistered(bool reg)
 	_registered = reg;
 }
 
+bool Client::hasCap(unsigned int cap) const
+{
+	return (_caps & cap) != 0;
+}
+
+unsigned int Client::getCaps() const
+{
+	return _caps;
+}
+
+void Client::setCaps(unsigned int caps)
+{
+	_caps = caps;
+}
+
+bool Client::isServer() const
+{
+	return _server;
+}
+
+void Client::setServer(bool server)
+{
+	_server = server;
+}
+
+Client *Client::getUplink() const
+{
+	return _uplink;
+}
+
+void Client::setUplink(Client *uplink)
+{
+	_uplink = uplink;
+}
+
+long Client::getNickTs() const
+{
+	return _nickTs;
+}
+
+void Client::setNickTs(long ts)
+{
+	_nickTs = ts;
+}
+
+const std::string &Client::getOrigin() const
+{
+	return _origin;
+}
+
+void Client::setOrigin(const std::string &origin)
+{
+	_origin = origin;
+}
+
+const std::vector<Channel *> &Client::getChannels() const
+{
+	return _channels;
+}
+
+void Client::addChannel(Channel *channel)
+{
+	if (std::find(_channels.begin(), _channels.end(), channel) == _channels.end())
+		_channels.push_back(channel);
+}
+
+void Client::removeChannel(Channel *channel)
+{
+	_channels.erase(std::remove(_channels.begin(), _channels.end(), channel), _channels.end());
+}
+
+bool Client::isOper() const
+{
+	return _oper;
+}
+
+void Client::setOper(bool oper)
+{
+	_oper = oper;
+}
+
+bool Client::isAway() const
+{
+	return !_away.empty();
+}
+
+const std::string &Client::getAway() const
+{
+	return _away;
+}
+
+void Client::setAway(const std::string &message)
+{
+	_away = message;
+}
+
+bool Client::isCapNegotiating() const
+{
+	return _capNegotiating;
+}
+
+void Client::setCapNegotiating(bool negotiating)
+{
+	_capNegotiating = negotiating;
+}
+
+void Client::sendTagged(const std::string &tags, const std::string &message)
+{
+	if (tags.empty() || !(_caps & (CAP_MESSAGE_TAGS | CAP_SERVER_TIME)))
+		sendMessage(message);
+	else if (_caps & CAP_MESSAGE_TAGS)
+		sendMessage("@" + tags + " " + message);
+	else
+		sendMessage("@" + tags.substr(0, tags.find(';')) + " " + message);
+}
+
 void Client::sendMessage(const std::string &message)
 {
-	if (_fd >= 0)
+	if (_ws)
+		sendRaw(WebSocket::frame(message));
+	else
+		sendRaw(message);
+}
+
+void Client::sendRaw(const std::string &data)
+{
+	if (_fd < 0)
+		return;
+
+	_outbuf += data;
+	if (!_blocked && _outbuf.size() >= CLIENT_CORK_LIMIT)
+		flush();
+}
+
+bool Client::isWebSocket() const
+{
+	return _ws != NULL;
+}
+
+bool Client::hasPendingOutput() const
+{
+	if (_tls)
+		return _tls->wantsWrite() || (!_outbuf.empty() && !_tls->wantsRead());
+	return !_outbuf.empty();
+}
+
+bool Client::hasCorkedOutput() const
+{
+	return !_blocked && !_outbuf.empty();
+}
+
+bool Client::isBlocked() const
+{
+	return _blocked;
+}
+
+size_t Client::getPendingOutput() const
+{
+	return _outbuf.size();
+}
+
+ssize_t Client::transmit(const char *data, size_t length)
+{
+	if (_tls)
+		return _tls->write(data, length);
+	return g_platform->send(_fd, data, length);
+}
+
+void Client::flush()
+{
+	if (_fd >= 0 && _tls && _outbuf.empty())
+		_tls->handshake();
+	if (_fd < 0 || _outbuf.empty())
+		return;
+
+	ssize_t sent = transmit(_outbuf.data(), _outbuf.size());
+	if (sent > 0)
 	{
-		send(_fd, message.c_str(), message.length(), 0);
+		g_metrics.addBytesOut(sent);
+		_outbuf.erase(0, sent);
 	}
+	_blocked = !_outbuf.empty();
 }
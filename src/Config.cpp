@@ -0,0 +1,219 @@
+#include "Config.hpp"
+#include "Server.hpp"
+#include "Channel.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cerrno>
+
+Config::Config()
+	: backlog(LISTEN_BACKLOG), recvSize(RECV_SIZE), clientSendq(CLIENT_SENDQ_LIMIT), linkSendq(LINK_SENDQ_LIMIT), corkLatency(CORK_LATENCY),
+	  historyLimit(CHANNEL_HISTORY_LIMIT), monitorLimit(MONITOR_LIMIT), monitorTotal(MONITOR_TOTAL_LIMIT),
+	  whoLimit(WHO_LIMIT), snapshotPath(""), snapshotInterval(300), fanoutThreads(0)
+{
+}
+
+static std::string trim(const std::string &value)
+{
+	size_t start = value.find_first_not_of(" \t\r");
+	if (start == std::string::npos)
+		return "";
+	return value.substr(start, value.find_last_not_of(" \t\r") - start + 1);
+}
+
+static std::vector<std::string> splitList(const std::string &list)
+{
+	std::vector<std::string> items;
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		if (!item.empty())
+			items.push_back(item);
+	}
+	return items;
+}
+
+static bool parseSize(const std::string &text, size_t &value)
+{
+	if (text.empty() || text[0] == '-')
+		return false;
+	char *end;
+	errno = 0;
+	unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+	if (*end || errno)
+		return false;
+	value = parsed;
+	return true;
+}
+
+static bool parseOper(const std::string &entry, std::map<std::string, std::string> &opers)
+{
+	size_t colon = entry.find(':');
+	if (colon == std::string::npos || colon == 0)
+		return false;
+	opers[entry.substr(0, colon)] = entry.substr(colon + 1);
+	return true;
+}
+
+static bool parseLink(const std::string &entry, std::vector<std::pair<std::string, int> > &links)
+{
+	size_t colon = entry.rfind(':');
+	size_t port;
+	if (colon == std::string::npos || colon == 0 || !parseSize(entry.substr(colon + 1), port) || port == 0 || port > 65535)
+		return false;
+	links.push_back(std::make_pair(entry.substr(0, colon), static_cast<int>(port)));
+	return true;
+}
+
+void Config::applyEnvironment()
+{
+	const char *value;
+	std::vector<std::string> items;
+
+	if ((value = std::getenv("IRCSERV_OPER")))
+	{
+		items = splitList(value);
+		for (std::vector<std::string>::iterator it = items.begin(); it != items.end(); ++it)
+			parseOper(*it, opers);
+	}
+	if ((value = std::getenv("IRCSERV_METRICS_SOCKET")) && *value)
+		metricsSocket = value;
+	if ((value = std::getenv("IRCSERV_MONITOR_LIMIT")) && *value)
+		parseSize(value, monitorLimit);
+	if ((value = std::getenv("IRCSERV_MONITOR_TOTAL")) && *value)
+		parseSize(value, monitorTotal);
+
+	const char *name = std::getenv("IRCSERV_NAME");
+	const char *linkPass = std::getenv("IRCSERV_LINK_PASSWORD");
+	if (name && *name && linkPass && *linkPass)
+	{
+		serverName = name;
+		linkPassword = linkPass;
+	}
+
+	if ((value = std::getenv("IRCSERV_TRACE")) && *value)
+		tracePath = value;
+	if ((value = std::getenv("IRCSERV_FANOUT_THREADS")) && *value)
+		parseSize(value, fanoutThreads);
+	if ((value = std::getenv("IRCSERV_TLS_CERT")) && *value)
+	{
+		tlsCertificate = value;
+		const char *key = std::getenv("IRCSERV_TLS_KEY");
+		tlsKey = key && *key ? key : value;
+	}
+	if ((value = std::getenv("IRCSERV_LISTEN")))
+	{
+		items = splitList(value);
+		listen.insert(listen.end(), items.begin(), items.end());
+	}
+	if ((value = std::getenv("IRCSERV_LINKS")))
+	{
+		items = splitList(value);
+		for (std::vector<std::string>::iterator it = items.begin(); it != items.end(); ++it)
+			parseLink(*it, links);
+	}
+}
+
+bool Config::load(const std::string &file, std::string &error)
+{
+	std::ifstream in(file.c_str());
+	if (!in)
+	{
+		error = "cannot open " + file;
+		return false;
+	}
+	path = file;
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line))
+	{
+		++lineNumber;
+		std::string entry = trim(line);
+		if (entry.empty() || entry[0] == '#')
+			continue;
+
+		std::ostringstream where;
+		where << file << ":" << lineNumber << ": ";
+		size_t equals = entry.find('=');
+		if (equals == std::string::npos)
+		{
+			error = where.str() + "expected 'key = value'";
+			return false;
+		}
+		std::string key = trim(entry.substr(0, equals));
+		std::string value = trim(entry.substr(equals + 1));
+		size_t parsed = 0;
+		bool ok = true;
+
+		if (key == "listen")
+			listen.push_back(value);
+		else if (key == "backlog")
+		{
+			ok = parseSize(value, parsed) && parsed > 0 && parsed <= 65535;
+			backlog = static_cast<int>(parsed);
+		}
+		else if (key == "recv_size")
+			ok = parseSize(value, recvSize) && recvSize >= 64;
+		else if (key == "client_sendq")
+			ok = parseSize(value, clientSendq) && clientSendq > 0;
+		else if (key == "link_sendq")
+			ok = parseSize(value, linkSendq) && linkSendq > 0;
+		else if (key == "cork_latency")
+			ok = parseSize(value, corkLatency);
+		else if (key == "history_limit")
+			ok = parseSize(value, historyLimit);
+		else if (key == "monitor_limit")
+			ok = parseSize(value, monitorLimit);
+		else if (key == "monitor_total")
+			ok = parseSize(value, monitorTotal);
+		else if (key == "who_limit")
+			ok = parseSize(value, whoLimit);
+		else if (key == "motd")
+			motd.push_back(value);
+		else if (key == "oper")
+			ok = parseOper(value, opers);
+		else if (key == "server_name")
+		{
+			serverName = value;
+			ok = !value.empty();
+		}
+		else if (key == "link_password")
+			linkPassword = value;
+		else if (key == "link")
+			ok = parseLink(value, links);
+		else if (key == "metrics_socket")
+			metricsSocket = value;
+		else if (key == "tls_certificate")
+			tlsCertificate = value;
+		else if (key == "tls_key")
+			tlsKey = value;
+		else if (key == "snapshot_path")
+			snapshotPath = value;
+		else if (key == "snapshot_interval")
+		{
+			ok = parseSize(value, parsed);
+			snapshotInterval = static_cast<int>(parsed);
+		}
+		else if (key == "trace_path")
+			tracePath = value;
+		else if (key == "fanout_threads")
+			ok = parseSize(value, fanoutThreads);
+		else
+		{
+			error = where.str() + "unknown setting '" + key + "'";
+			return false;
+		}
+
+		if (!ok)
+		{
+			error = where.str() + "invalid value for '" + key + "'";
+			return false;
+		}
+	}
+
+	if (!tlsCertificate.empty() && tlsKey.empty())
+		tlsKey = tlsCertificate;
+	return true;
+}
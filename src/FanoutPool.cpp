@@ -0,0 +1,132 @@
+#include "FanoutPool.hpp"
+#include "Client.hpp"
+
+FanoutPool g_fanout;
+
+FanoutPool::FanoutPool() : _next(0), _pending(0), _stopping(false)
+{
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_work, NULL);
+	pthread_cond_init(&_done, NULL);
+}
+
+FanoutPool::~FanoutPool()
+{
+	stop();
+	pthread_cond_destroy(&_done);
+	pthread_cond_destroy(&_work);
+	pthread_mutex_destroy(&_mutex);
+}
+
+void FanoutPool::start(size_t workers)
+{
+	stop();
+	_stopping = false;
+	for (size_t i = 0; i < workers; ++i)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, &FanoutPool::worker, this) != 0)
+			break;
+		_threads.push_back(thread);
+	}
+}
+
+void FanoutPool::stop()
+{
+	if (_threads.empty())
+		return;
+
+	pthread_mutex_lock(&_mutex);
+	_stopping = true;
+	pthread_cond_broadcast(&_work);
+	pthread_mutex_unlock(&_mutex);
+
+	for (size_t i = 0; i < _threads.size(); ++i)
+		pthread_join(_threads[i], NULL);
+	_threads.clear();
+}
+
+size_t FanoutPool::size() const
+{
+	return _threads.size();
+}
+
+void FanoutPool::run(const std::vector<FanoutTask> &tasks)
+{
+	if (tasks.empty())
+		return;
+
+	pthread_mutex_lock(&_mutex);
+	_tasks = tasks;
+	_next = 0;
+	_pending = tasks.size();
+	pthread_cond_broadcast(&_work);
+	pthread_mutex_unlock(&_mutex);
+
+	while (runNext(false))
+		;
+
+	pthread_mutex_lock(&_mutex);
+	while (_pending > 0)
+		pthread_cond_wait(&_done, &_mutex);
+	_tasks.clear();
+	pthread_mutex_unlock(&_mutex);
+}
+
+void FanoutPool::deliver(const FanoutTask &task)
+{
+	for (size_t i = 0; i < task.count; ++i)
+	{
+		Client *client = task.clients[i];
+		if (client == task.sender)
+			continue;
+
+		const std::string *message = task.plain;
+		const std::string *framed = task.framedPlain;
+		if (task.tagged && client->hasCap(CAP_MESSAGE_TAGS))
+		{
+			message = task.tagged;
+			framed = task.framedTagged;
+		}
+		else if (task.tagged && client->hasCap(CAP_SERVER_TIME))
+		{
+			message = task.timed;
+			framed = task.framedTimed;
+		}
+
+		if (framed && client->isWebSocket())
+			client->sendRaw(*framed);
+		else
+			client->sendMessage(*message);
+	}
+}
+
+void *FanoutPool::worker(void *arg)
+{
+	FanoutPool *pool = static_cast<FanoutPool *>(arg);
+	while (pool->runNext(true))
+		;
+	return NULL;
+}
+
+bool FanoutPool::runNext(bool wait)
+{
+	pthread_mutex_lock(&_mutex);
+	while (wait && !_stopping && _next >= _tasks.size())
+		pthread_cond_wait(&_work, &_mutex);
+	if (_stopping || _next >= _tasks.size())
+	{
+		pthread_mutex_unlock(&_mutex);
+		return false;
+	}
+	FanoutTask task = _tasks[_next++];
+	pthread_mutex_unlock(&_mutex);
+
+	deliver(task);
+
+	pthread_mutex_lock(&_mutex);
+	if (--_pending == 0)
+		pthread_cond_broadcast(&_done);
+	pthread_mutex_unlock(&_mutex);
+	return true;
+}
@@ -0,0 +1,53 @@
+#include "Fuzz.hpp"
+#include <iostream>
+
+#define FUZZ_CLIENTS 3
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size > FUZZ_MAX_INPUT)
+        return 0;
+    std::cout.setstate(std::ios::badbit);
+
+    Simulation sim(1);
+    int fds[FUZZ_CLIENTS + 1];
+    for (int i = 0; i < FUZZ_CLIENTS; ++i)
+    {
+        char nick = static_cast<char>('0' + i);
+        fds[i] = sim.connect();
+        sim.input(fds[i], std::string("PASS sim\r\nNICK f") + nick + "\r\nUSER f" + nick + " 0 * :Fuzz\r\nJOIN #fuzz\r\n");
+    }
+    fds[FUZZ_CLIENTS] = sim.connect();
+    sim.input(fds[FUZZ_CLIENTS], "SERVER leaf.sim sim :Fuzz leaf\r\n");
+    sim.tick(1);
+    fuzzCheck(sim, "setup");
+
+    std::string input(reinterpret_cast<const char *>(data), size);
+    size_t start = 0;
+    while (start < input.size())
+    {
+        size_t end = input.find('\n', start);
+        if (end == std::string::npos)
+            end = input.size();
+        std::string line = input.substr(start, end - start);
+        start = end + 1;
+
+        int target = 0;
+        if (!line.empty() && line[0] >= '0' && line[0] <= '0' + FUZZ_CLIENTS)
+        {
+            target = line[0] - '0';
+            line.erase(0, 1);
+        }
+        if (!sim.isConnected(fds[target]))
+            continue;
+        sim.input(fds[target], line + "\r\n");
+        sim.tick(1);
+        fuzzCheck(sim, "dispatch");
+    }
+
+    for (int i = 0; i <= FUZZ_CLIENTS; ++i)
+        sim.disconnect(fds[i]);
+    sim.tick(1);
+    fuzzCheck(sim, "teardown");
+    return 0;
+}
@@ -0,0 +1,22 @@
+#include "Fuzz.hpp"
+#include <iostream>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 1 || size > FUZZ_MAX_INPUT)
+        return 0;
+    std::cout.setstate(std::ios::badbit);
+
+    Simulation sim(1);
+    size_t chunk = (data[0] >> 1) + 1;
+    int fd = sim.connect(data[0] & 1);
+    std::string input(reinterpret_cast<const char *>(data) + 1, size - 1);
+    for (size_t pos = 0; pos < input.size() && sim.isConnected(fd); pos += chunk)
+        sim.input(fd, input.substr(pos, chunk));
+    sim.tick(1);
+    fuzzCheck(sim, "after input");
+    sim.disconnect(fd);
+    sim.tick(1);
+    fuzzCheck(sim, "after disconnect");
+    return 0;
+}
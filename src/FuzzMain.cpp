@@ -0,0 +1,189 @@
+#include "Fuzz.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <csignal>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define FUZZ_CRASH_FILE "crash-input"
+
+volatile sig_atomic_t g_stop = 0;
+volatile sig_atomic_t g_upgrade = 0;
+volatile sig_atomic_t g_rehash = 0;
+
+static const std::string *g_current = NULL;
+static unsigned long long g_state = 88172645463325252ULL;
+
+static const char *const g_tokens[] = {
+    "\r\n", "\n", " ", " :", ":", "@", "+", "-", "*", "!", "#fuzz", "f0", "f1", "f2",
+    "+o", "-o", "+v", "+k", "+l", "+b", "+i", "+t", "MODE ", "JOIN ", "PART ", "KICK ",
+    "PRIVMSG ", "NICK ", "TOPIC ", "WHO ", "UID ", "SJOIN ", ":leaf.sim ", "\x81\x85", "\x88\x80"
+};
+
+static void HandleCrash(int sig)
+{
+    if (g_current)
+    {
+        int fd = open(FUZZ_CRASH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0)
+        {
+            ssize_t written = write(fd, g_current->data(), g_current->size());
+            (void)written;
+            close(fd);
+        }
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static unsigned long nextRandom()
+{
+    g_state ^= g_state << 13;
+    g_state ^= g_state >> 7;
+    g_state ^= g_state << 17;
+    return static_cast<unsigned long>(g_state >> 11);
+}
+
+static void runInput(const std::string &input)
+{
+    g_current = &input;
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+    g_current = NULL;
+}
+
+static bool readFile(const std::string &path, std::string &contents)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in)
+        return false;
+    std::ostringstream oss;
+    oss << in.rdbuf();
+    contents = oss.str();
+    return true;
+}
+
+static void loadPath(const std::string &path, std::vector<std::string> &corpus)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        std::cerr << "cannot open " << path << std::endl;
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        std::string contents;
+        if (readFile(path, contents))
+            corpus.push_back(contents);
+        return;
+    }
+
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    std::vector<std::string> names;
+    while (dirent *entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.')
+            names.push_back(path + "/" + entry->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); ++it)
+    {
+        std::string contents;
+        if (stat(it->c_str(), &st) == 0 && S_ISREG(st.st_mode) && readFile(*it, contents))
+            corpus.push_back(contents);
+    }
+}
+
+static std::string mutate(const std::vector<std::string> &corpus)
+{
+    std::string input = corpus.empty() ? std::string() : corpus[nextRandom() % corpus.size()];
+    int rounds = 1 + nextRandom() % 4;
+    for (int i = 0; i < rounds; ++i)
+    {
+        size_t pos = input.empty() ? 0 : nextRandom() % (input.size() + 1);
+        switch (nextRandom() % 6)
+        {
+        case 0:
+            if (pos < input.size())
+                input[pos] ^= static_cast<char>(1 << (nextRandom() % 8));
+            break;
+        case 1:
+            input.insert(pos, 1, static_cast<char>(nextRandom() & 0xff));
+            break;
+        case 2:
+            if (pos < input.size())
+                input.erase(pos, 1 + nextRandom() % (input.size() - pos));
+            break;
+        case 3:
+            input.insert(pos, g_tokens[nextRandom() % (sizeof(g_tokens) / sizeof(g_tokens[0]))]);
+            break;
+        case 4:
+            if (pos < input.size())
+                input.insert(nextRandom() % (input.size() + 1), input.substr(pos, 1 + nextRandom() % 32));
+            break;
+        default:
+            if (!corpus.empty())
+            {
+                const std::string &other = corpus[nextRandom() % corpus.size()];
+                input = input.substr(0, pos) + other.substr(other.empty() ? 0 : nextRandom() % other.size());
+            }
+            break;
+        }
+    }
+    if (input.size() > FUZZ_MAX_INPUT)
+        input.resize(FUZZ_MAX_INPUT);
+    return input;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long runs = 0;
+    std::vector<std::string> corpus;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            runs = std::strtoul(argv[++i], NULL, 10);
+        else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            g_state ^= std::strtoull(argv[++i], NULL, 10) * 2654435761ULL;
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Usage: " << argv[0] << " [-r runs] [-s seed] [file|directory...]" << std::endl;
+            return 1;
+        }
+        else
+            paths.push_back(argv[i]);
+    }
+
+    signal(SIGSEGV, HandleCrash);
+    signal(SIGABRT, HandleCrash);
+    signal(SIGBUS, HandleCrash);
+    signal(SIGFPE, HandleCrash);
+
+    if (paths.empty() && runs == 0)
+    {
+        std::ostringstream oss;
+        oss << std::cin.rdbuf();
+        runInput(oss.str());
+        return 0;
+    }
+
+    for (std::vector<std::string>::iterator it = paths.begin(); it != paths.end(); ++it)
+        loadPath(*it, corpus);
+    for (std::vector<std::string>::iterator it = corpus.begin(); it != corpus.end(); ++it)
+        runInput(*it);
+    for (unsigned long i = 0; i < runs; ++i)
+        runInput(mutate(corpus));
+    std::fprintf(stderr, "%s: %lu corpus inputs, %lu mutated runs\n", argv[0],
+                 static_cast<unsigned long>(corpus.size()), runs);
+    return 0;
+}
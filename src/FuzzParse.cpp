@@ -0,0 +1,62 @@
+#include "Fuzz.hpp"
+#include "Server.hpp"
+#include <iostream>
+
+#define FUZZ_TIME_LIMIT 253402300800000LL
+
+static void checkSplit(Simulation &sim, const std::string &line)
+{
+    size_t offset = 0;
+    if (!line.empty() && line[0] == '@')
+    {
+        offset = line.find(' ');
+        if (offset == std::string::npos)
+            return;
+        ++offset;
+    }
+
+    std::vector<std::string> args = sim.split(line, offset);
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        if (args[i].empty())
+            std::abort();
+        if (i + 1 < args.size() && args[i].find(' ') != std::string::npos)
+            std::abort();
+        if (i > 0 && i + 1 < args.size() && args[i][0] == ':')
+            std::abort();
+    }
+}
+
+static void checkTime(const std::string &text)
+{
+    long long ms;
+    if (!Server::parseServerTime(text, ms) || ms < 0 || ms >= FUZZ_TIME_LIMIT)
+        return;
+    long long again;
+    if (!Server::parseServerTime(Server::formatServerTime(ms), again) || again != ms)
+        std::abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size > FUZZ_MAX_INPUT)
+        return 0;
+    std::cout.setstate(std::ios::badbit);
+    static Simulation sim(1);
+
+    std::string input(reinterpret_cast<const char *>(data), size);
+    checkSplit(sim, input);
+    checkTime(input);
+
+    size_t separator = input.find('\n');
+    if (separator != std::string::npos)
+    {
+        std::string mask = input.substr(0, separator);
+        std::string value = input.substr(separator + 1);
+        if (!Simulation::match(value, value))
+            std::abort();
+        if (mask.find_first_of("*?") == std::string::npos && Simulation::match(mask, value) && mask.size() != value.size())
+            std::abort();
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "Metrics.hpp"
+#include <sstream>
+#include <time.h>
+
+Metrics g_metrics;
+
+Histogram::Histogram() : sum(0), count(0)
+{
+	for (int i = 0; i < METRICS_BUCKETS; ++i)
+		buckets[i] = 0;
+}
+
+void Histogram::record(unsigned long long usec)
+{
+	int bucket = 0;
+	while (bucket < METRICS_BUCKETS - 1 && usec > (1ULL << bucket))
+		++bucket;
+	++buckets[bucket];
+	sum += usec;
+	++count;
+}
+
+Metrics::Metrics()
+	: _bytesIn(0), _bytesOut(0), _connectionsOpened(0), _connectionsClosed(0), _startTime(nowUsec())
+{
+}
+
+unsigned long long Metrics::nowUsec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long long>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void Metrics::recordCommand(const std::string &name, unsigned long long usec)
+{
+	std::map<std::string, Histogram>::iterator it = _commands.find(name);
+	if (it == _commands.end())
+		it = _commands.insert(std::make_pair(name, Histogram())).first;
+	it->second.record(usec);
+}
+
+void Metrics::recordLoop(unsigned long long usec)
+{
+	_loop.record(usec);
+}
+
+void Metrics::addBytesIn(size_t bytes)
+{
+	_bytesIn += bytes;
+}
+
+void Metrics::addBytesOut(size_t bytes)
+{
+	__sync_fetch_and_add(&_bytesOut, static_cast<unsigned long long>(bytes));
+}
+
+void Metrics::connectionOpened()
+{
+	++_connectionsOpened;
+}
+
+void Metrics::connectionClosed()
+{
+	++_connectionsClosed;
+}
+
+const std::map<std::string, Histogram> &Metrics::getCommands() const
+{
+	return _commands;
+}
+
+const Histogram &Metrics::getLoop() const
+{
+	return _loop;
+}
+
+unsigned long long Metrics::getBytesIn() const
+{
+	return _bytesIn;
+}
+
+unsigned long long Metrics::getBytesOut() const
+{
+	return _bytesOut;
+}
+
+unsigned long long Metrics::getConnectionsOpened() const
+{
+	return _connectionsOpened;
+}
+
+unsigned long long Metrics::getConnectionsClosed() const
+{
+	return _connectionsClosed;
+}
+
+unsigned long long Metrics::getStartTime() const
+{
+	return _startTime;
+}
+
+static void writeHistogram(std::ostringstream &out, const std::string &name, const std::string &labels, const Histogram &histogram)
+{
+	std::string sep = labels.empty() ? "" : ",";
+	unsigned long long cumulative = 0;
+	for (int i = 0; i < METRICS_BUCKETS; ++i)
+	{
+		cumulative += histogram.buckets[i];
+		out << name << "_bucket{" << labels << sep << "le=\"";
+		if (i == METRICS_BUCKETS - 1)
+			out << "+Inf";
+		else
+			out << (1ULL << i) / 1e6;
+		out << "\"} " << cumulative << "\n";
+	}
+	std::string braces = labels.empty() ? "" : "{" + labels + "}";
+	out << name << "_sum" << braces << " " << histogram.sum / 1e6 << "\n";
+	out << name << "_count" << braces << " " << histogram.count << "\n";
+}
+
+std::string Metrics::prometheus(size_t clients, size_t channels, size_t queued) const
+{
+	std::ostringstream out;
+	out.precision(9);
+
+	out << "# TYPE ircserv_commands_seconds histogram\n";
+	for (std::map<std::string, Histogram>::const_iterator it = _commands.begin(); it != _commands.end(); ++it)
+		writeHistogram(out, "ircserv_commands_seconds", "command=\"" + it->first + "\"", it->second);
+
+	out << "# TYPE ircserv_loop_iteration_seconds histogram\n";
+	writeHistogram(out, "ircserv_loop_iteration_seconds", "", _loop);
+
+	out << "# TYPE ircserv_received_bytes_total counter\n";
+	out << "ircserv_received_bytes_total " << _bytesIn << "\n";
+	out << "# TYPE ircserv_sent_bytes_total counter\n";
+	out << "ircserv_sent_bytes_total " << _bytesOut << "\n";
+	out << "# TYPE ircserv_connections_opened_total counter\n";
+	out << "ircserv_connections_opened_total " << _connectionsOpened << "\n";
+	out << "# TYPE ircserv_connections_closed_total counter\n";
+	out << "ircserv_connections_closed_total " << _connectionsClosed << "\n";
+	out << "# TYPE ircserv_clients gauge\n";
+	out << "ircserv_clients " << clients << "\n";
+	out << "# TYPE ircserv_channels gauge\n";
+	out << "ircserv_channels " << channels << "\n";
+	out << "# TYPE ircserv_queued_bytes gauge\n";
+	out << "ircserv_queued_bytes " << queued << "\n";
+	out << "# TYPE ircserv_uptime_seconds gauge\n";
+	out << "ircserv_uptime_seconds " << (nowUsec() - _startTime) / 1000000ULL << "\n";
+	return out.str();
+}
@@ -0,0 +1,33 @@
+#include "Platform.hpp"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+Platform::~Platform()
+{
+}
+
+ssize_t Platform::send(int fd, const char *data, size_t length)
+{
+	return ::send(fd, data, length, MSG_NOSIGNAL);
+}
+
+ssize_t Platform::recv(int fd, char *buffer, size_t length)
+{
+	return ::recv(fd, buffer, length, 0);
+}
+
+void Platform::close(int fd)
+{
+	::close(fd);
+}
+
+long long Platform::now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return static_cast<long long>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+static Platform g_systemPlatform;
+Platform *g_platform = &g_systemPlatform;
@@ -0,0 +1,332 @@
+#include "Simulation.hpp"
+#include "Trace.hpp"
+#include "Metrics.hpp"
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <cerrno>
+#include <csignal>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define REPLAY_DRAIN_EVERY 64
+#define REPLAY_GRACE_MS 1000
+
+volatile sig_atomic_t g_stop = 0;
+volatile sig_atomic_t g_upgrade = 0;
+volatile sig_atomic_t g_rehash = 0;
+
+struct ReplayStats
+{
+    unsigned long records;
+    unsigned long connections;
+    unsigned long lines;
+    unsigned long long bytesOut;
+    unsigned long long bytesIn;
+
+    ReplayStats() : records(0), connections(0), lines(0), bytesOut(0), bytesIn(0) {}
+};
+
+static std::string rewritePassword(const std::string &line, const std::string &password)
+{
+    if (password.empty() || line.size() < 5 || strncasecmp(line.c_str(), "PASS ", 5) != 0)
+        return line;
+    return "PASS " + password;
+}
+
+static void printReport(const ReplayStats &stats, unsigned long long started)
+{
+    double elapsed = (Metrics::nowUsec() - started) / 1000.0;
+    std::printf("records %lu  connections %lu  lines %lu  %.1f ms  %.0f lines/s  bytes out %llu  in %llu\n",
+                stats.records, stats.connections, stats.lines, elapsed,
+                elapsed > 0 ? stats.lines * 1000.0 / elapsed : 0.0, stats.bytesOut, stats.bytesIn);
+}
+
+static int replayInProcess(TraceReader &reader, const std::string &password, bool paranoid)
+{
+    std::cout.setstate(std::ios::badbit);
+    Simulation sim(1);
+    std::map<uint32_t, int> fds;
+    ReplayStats stats;
+    TraceRecord record;
+    long long clock = -1;
+    unsigned long long started = Metrics::nowUsec();
+
+    while (reader.next(record))
+    {
+        ++stats.records;
+        if (clock >= 0 && record.time > clock)
+        {
+            sim.tick(record.time - clock);
+            if (paranoid)
+            {
+                std::string error;
+                if (!sim.check(error))
+                {
+                    std::fprintf(stderr, "record %lu: invariant violated: %s\n", stats.records, error.c_str());
+                    return 1;
+                }
+            }
+        }
+        if (clock < record.time)
+            clock = record.time;
+
+        std::map<uint32_t, int>::iterator it = fds.find(record.connection);
+        if (record.event == TRACE_CLOSE)
+        {
+            if (it != fds.end())
+            {
+                sim.disconnect(it->second);
+                fds.erase(it);
+            }
+            continue;
+        }
+        if (record.event == TRACE_OPEN && it != fds.end())
+        {
+            sim.disconnect(it->second);
+            fds.erase(it);
+            it = fds.end();
+        }
+        if (it == fds.end() || !sim.isConnected(it->second))
+        {
+            fds[record.connection] = sim.connect();
+            it = fds.find(record.connection);
+            ++stats.connections;
+        }
+        if (record.event == TRACE_LINE)
+        {
+            std::string line = rewritePassword(record.line, password) + "\r\n";
+            ++stats.lines;
+            stats.bytesOut += line.size();
+            sim.input(it->second, line);
+        }
+    }
+    sim.tick(1);
+    stats.bytesIn = sim.bytesOut();
+
+    std::string error;
+    if (!sim.check(error))
+    {
+        std::fprintf(stderr, "end of trace: invariant violated: %s\n", error.c_str());
+        return 1;
+    }
+    printReport(stats, started);
+    std::printf("sends %llu  digest %016llx\n", sim.sends(), sim.digest());
+    return reader.failed() ? 1 : 0;
+}
+
+static int openSocket(const std::string &target)
+{
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos)
+        return -1;
+    std::string host = target.substr(0, colon);
+    if (host.size() > 1 && host[0] == '[' && host[host.size() - 1] == ']')
+        host = host.substr(1, host.size() - 2);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result;
+    if (getaddrinfo(host.c_str(), target.c_str() + colon + 1, &hints, &result) != 0)
+        return -1;
+
+    int fd = -1;
+    for (addrinfo *ai = result; ai && fd < 0; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (fd >= 0)
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+static void closeSocket(int fd, ReplayStats &stats)
+{
+    char buffer[65536];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+        stats.bytesIn += n;
+    close(fd);
+}
+
+static void drain(std::map<uint32_t, int> &sockets, int timeoutMs, ReplayStats &stats)
+{
+    std::vector<pollfd> pfds;
+    for (std::map<uint32_t, int>::iterator it = sockets.begin(); it != sockets.end(); ++it)
+    {
+        pollfd pfd;
+        pfd.fd = it->second;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        pfds.push_back(pfd);
+    }
+    if (pfds.empty())
+    {
+        if (timeoutMs > 0)
+            poll(NULL, 0, timeoutMs);
+        return;
+    }
+    if (poll(&pfds[0], pfds.size(), timeoutMs) <= 0)
+        return;
+
+    char buffer[65536];
+    for (std::map<uint32_t, int>::iterator it = sockets.begin(); it != sockets.end();)
+    {
+        ssize_t n;
+        while ((n = recv(it->second, buffer, sizeof(buffer), 0)) > 0)
+            stats.bytesIn += n;
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            close(it->second);
+            sockets.erase(it++);
+        }
+        else
+            ++it;
+    }
+}
+
+static bool sendLine(std::map<uint32_t, int> &sockets, uint32_t connection, const std::string &line, ReplayStats &stats)
+{
+    size_t sent = 0;
+    while (sent < line.size())
+    {
+        std::map<uint32_t, int>::iterator it = sockets.find(connection);
+        if (it == sockets.end())
+            return false;
+        ssize_t n = send(it->second, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (n > 0)
+            sent += n;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            drain(sockets, 10, stats);
+        else
+            return false;
+    }
+    stats.bytesOut += sent;
+    return true;
+}
+
+static long long wallMs()
+{
+    return static_cast<long long>(Metrics::nowUsec() / 1000);
+}
+
+static int replaySockets(TraceReader &reader, const std::string &target, const std::string &password, double speed)
+{
+    std::map<uint32_t, int> sockets;
+    ReplayStats stats;
+    TraceRecord record;
+    long long first = -1;
+    long long start = wallMs();
+    unsigned long long started = Metrics::nowUsec();
+
+    while (reader.next(record))
+    {
+        ++stats.records;
+        if (first < 0)
+            first = record.time;
+        if (speed > 0)
+        {
+            long long due = start + static_cast<long long>((record.time - first) / speed);
+            for (long long now = wallMs(); now < due; now = wallMs())
+                drain(sockets, static_cast<int>(due - now), stats);
+        }
+        if (stats.records % REPLAY_DRAIN_EVERY == 0)
+            drain(sockets, 0, stats);
+
+        std::map<uint32_t, int>::iterator it = sockets.find(record.connection);
+        if (it != sockets.end() && record.event != TRACE_LINE)
+        {
+            closeSocket(it->second, stats);
+            sockets.erase(it);
+            it = sockets.end();
+        }
+        if (record.event == TRACE_CLOSE)
+            continue;
+        if (it == sockets.end())
+        {
+            int fd = openSocket(target);
+            if (fd < 0)
+            {
+                std::fprintf(stderr, "cannot connect to %s\n", target.c_str());
+                break;
+            }
+            sockets[record.connection] = fd;
+            ++stats.connections;
+        }
+        if (record.event == TRACE_LINE)
+        {
+            ++stats.lines;
+            sendLine(sockets, record.connection, rewritePassword(record.line, password) + "\r\n", stats);
+        }
+    }
+
+    unsigned long long before;
+    do
+    {
+        before = stats.bytesIn;
+        drain(sockets, REPLAY_GRACE_MS, stats);
+    } while (stats.bytesIn != before && !sockets.empty());
+    for (std::map<uint32_t, int>::iterator it = sockets.begin(); it != sockets.end(); ++it)
+        closeSocket(it->second, stats);
+
+    printReport(stats, started);
+    return reader.failed() ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bool paranoid = false;
+    bool usage = false;
+    double speed = 1.0;
+    std::string password;
+    std::string target;
+    std::string path;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-c") == 0)
+            paranoid = true;
+        else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            speed = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            password = argv[++i];
+        else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            target = argv[++i];
+        else if (path.empty() && argv[i][0] != '-')
+            path = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || path.empty() || speed < 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-c] [-s speed] [-p password] [-t host:port] <trace>" << std::endl;
+        return 1;
+    }
+
+    TraceReader reader;
+    std::string error;
+    if (!reader.open(path, error))
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (target.empty())
+        return replayInProcess(reader, "sim", paranoid);
+    return replaySockets(reader, target, password, speed);
+}
@@ -1,23 +1,35 @@
 #include "Server.hpp"
 #include "Client.hpp"
 #include "Channel.hpp"
+#include "Metrics.hpp"
+#include "Tls.hpp"
 #include <iostream>
 #include <cstring>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netdb.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
+#include <cerrno>
 
 Server::Server(int port, const char *password)
-    : _port(port), _password(std::string(password)), _listen_fd(-1)
+    : _port(port), _password(std::string(password)), _config(new Config()),
+      _startTime(currentTimeMs()), _msgidSeq(0), _batchSeq(0),
+      _snapshotPath(""), _snapshotInterval(0),
+      _metrics_fd(-1), _serverName("localhost"), _nextLinkRetry(0), _whowasNext(0), _monitorTotal(0)
 {
 }
 
 Server::~Server()
 {
 
+    for (std::map<std::string, Client *>::iterator it = _clients_by_nick.begin(); it != _clients_by_nick.end(); ++it)
+    {
+        if (it->second->getUplink())
+            delete it->second;
+    }
     for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
     {
         delete it->second;
@@ -31,67 +43,184 @@ Server::~Server()
     }
     _channels.clear();
 
-    if (_listen_fd >= 0)
-        close(_listen_fd);
+    for (std::map<int, MetricsConn>::iterator it = _metricsConns.begin(); it != _metricsConns.end(); ++it)
+        close(it->first);
+    for (std::vector<LinkAttempt *>::iterator it = _linkAttempts.begin(); it != _linkAttempts.end(); ++it)
+    {
+        LinkAttempt *attempt = *it;
+        if (attempt->wake[0] >= 0)
+        {
+            pthread_join(attempt->resolver, NULL);
+            close(attempt->wake[0]);
+            close(attempt->wake[1]);
+        }
+        if (attempt->fd >= 0)
+            close(attempt->fd);
+        if (attempt->result)
+            freeaddrinfo(attempt->result);
+        delete attempt;
+    }
+    if (_metrics_fd >= 0)
+    {
+        close(_metrics_fd);
+        unlink(_metricsPath.c_str());
+    }
+
+    closeListeners(true);
+    delete _config;
 }
 
 void Server::run()
 {
-    _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (_listen_fd < 0)
-    {
-        std::cerr << "Socket could not be created" << std::endl;
+    FD_ZERO(&_master_set);
+    _fd_max = 0;
+    if (!openListeners())
         return;
-    }
 
-    int opt = 1;
-    setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    fcntl(_listen_fd, F_SETFL, O_NONBLOCK);
-
-    sockaddr_in serv_addr;
-    std::memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(_port);
+    openMetricsSocket();
+    loadSnapshot();
+    serve();
+}
 
-    if (bind(_listen_fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
-    {
-        std::cerr << "Bind error" << std::endl;
-        close(_listen_fd);
-        return;
-    }
+void Server::serve()
+{
+    long long nextSnapshot = currentTimeMs() + _snapshotInterval * 1000LL;
+    long long restoredUntil = _channels.empty() ? 0 : currentTimeMs() + SNAPSHOT_REJOIN_GRACE * 1000LL;
 
-    if (listen(_listen_fd, 10) < 0)
+    while (!g_stop)
     {
-        std::cerr << "Listen error" << std::endl;
-        close(_listen_fd);
-        return;
-    }
+        if (g_upgrade)
+        {
+            g_upgrade = 0;
+            if (upgrade())
+                return;
+        }
 
-    std::cout << "IRC Server is running on port " << _port << std::endl;
+        if (g_rehash)
+        {
+            g_rehash = 0;
+            std::string error;
+            if (!rehash(error))
+                std::cerr << "Rehash failed: " << error << std::endl;
+        }
 
-    FD_ZERO(&_master_set);
-    FD_SET(_listen_fd, &_master_set);
-    _fd_max = _listen_fd;
+        bool listing = continueLists();
+        flushClients();
+        _trace.flush(currentTimeMs());
 
-    while (!g_stop)
-    {
+        long long metricsExpiry = expireMetrics(currentTimeMs());
         _read_fds = _master_set;
-        int activity = select(_fd_max + 1, &_read_fds, NULL, NULL, NULL);
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
+        std::vector<std::pair<Client *, std::string> > dropped;
+        for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+        {
+            Client *client = it->second;
+            if (client->_tls && client->_tls->hasFailed())
+            {
+                dropped.push_back(std::make_pair(client, "TLS error"));
+                continue;
+            }
+            if (!client->hasPendingOutput())
+                continue;
+            size_t limit = client->isServer() ? _config->linkSendq : (client->_sendq ? client->_sendq : _config->clientSendq);
+            if (client->getPendingOutput() > limit)
+                dropped.push_back(std::make_pair(client, "SendQ exceeded"));
+            else
+                FD_SET(it->first, &write_fds);
+        }
+        for (std::vector<std::pair<Client *, std::string> >::iterator it = dropped.begin(); it != dropped.end(); ++it)
+        {
+            FD_CLR(it->first->getFd(), &_read_fds);
+            removeClient(it->first, it->second);
+        }
+        for (std::map<int, MetricsConn>::iterator it = _metricsConns.begin(); it != _metricsConns.end(); ++it)
+        {
+            if (!it->second.output.empty())
+                FD_SET(it->first, &write_fds);
+        }
+        for (std::vector<LinkAttempt *>::iterator it = _linkAttempts.begin(); it != _linkAttempts.end(); ++it)
+        {
+            if ((*it)->fd >= 0)
+                FD_SET((*it)->fd, &write_fds);
+        }
+
+        long long now = currentTimeMs();
+        long long deadline = 0;
+        if (_snapshotInterval > 0)
+            deadline = nextSnapshot;
+        if (restoredUntil && (!deadline || restoredUntil < deadline))
+            deadline = restoredUntil;
+        if (metricsExpiry && (!deadline || metricsExpiry < deadline))
+            deadline = metricsExpiry;
+        if (!_config->links.empty() && (!deadline || _nextLinkRetry < deadline))
+            deadline = _nextLinkRetry;
+
+        timeval timeout;
+        timeval *timeoutPtr = NULL;
+        if (listing)
+            deadline = now;
+        if (deadline)
+        {
+            long long wait = (deadline > now) ? deadline - now : 0;
+            timeout.tv_sec = wait / 1000;
+            timeout.tv_usec = (wait % 1000) * 1000;
+            timeoutPtr = &timeout;
+        }
+
+        int activity = select(_fd_max + 1, &_read_fds, &write_fds, NULL, timeoutPtr);
         if (activity < 0)
         {
+            if (errno == EINTR)
+                continue;
             std::cerr << "select() error" << std::endl;
             break;
         }
 
+        if (!_linkAttempts.empty())
+            continueLinks(write_fds);
+        if (_snapshotInterval > 0 && currentTimeMs() >= nextSnapshot)
+        {
+            saveSnapshot();
+            nextSnapshot = currentTimeMs() + _snapshotInterval * 1000LL;
+        }
+        if (restoredUntil && currentTimeMs() >= restoredUntil)
+        {
+            dropEmptyChannels();
+            restoredUntil = 0;
+        }
+        if (!_config->links.empty() && currentTimeMs() >= _nextLinkRetry)
+        {
+            retryAutoconnect();
+            _nextLinkRetry = currentTimeMs() + LINK_RETRY_INTERVAL * 1000LL;
+        }
+
+        unsigned long long loopStart = Metrics::nowUsec();
+        unsigned long long corkStart = loopStart;
         for (int fd = 0; fd <= _fd_max; ++fd)
         {
+            if (_config->corkLatency && Metrics::nowUsec() - corkStart >= _config->corkLatency)
+            {
+                flushClients();
+                corkStart = Metrics::nowUsec();
+            }
+            if (FD_ISSET(fd, &write_fds))
+            {
+                std::map<int, Client *>::iterator it = _clients.find(fd);
+                if (it != _clients.end())
+                    it->second->flush();
+                else if (_metricsConns.count(fd))
+                    flushMetrics(fd);
+            }
             if (FD_ISSET(fd, &_read_fds))
             {
-                if (fd == _listen_fd)
+                if (Listener *listener = findListener(fd))
                 {
-                    handleNewConnection(fd);
+                    handleNewConnection(listener);
+                }
+                else if (fd == _metrics_fd || _metricsConns.count(fd))
+                {
+                    handleMetricsRequest(fd);
                 }
                 else
                 {
@@ -103,5 +232,8 @@ void Server::run()
                 }
             }
         }
+        g_metrics.recordLoop(Metrics::nowUsec() - loopStart);
     }
+
+    saveSnapshot();
 }
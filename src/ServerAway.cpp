@@ -0,0 +1,90 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+
+void Server::handleAway(Client *client, const std::vector<std::string> &args)
+{
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+
+    std::string message;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        std::string part = args[i];
+        if (i == 1 && !part.empty() && part[0] == ':')
+            part = part.substr(1);
+        if (!message.empty())
+            message += " ";
+        message += part;
+    }
+    if (message.size() > AWAY_LENGTH)
+        message.resize(AWAY_LENGTH);
+
+    if (message.empty())
+        client->sendMessage(":localhost 305 " + client->getNickname() + " :You are no longer marked as being away\r\n");
+    else
+        client->sendMessage(":localhost 306 " + client->getNickname() + " :You have been marked as being away\r\n");
+    if (message == client->getAway())
+        return;
+    setAway(client, message);
+    sendToLinks(":" + client->getNickname() + " AWAY" + (message.empty() ? "" : " :" + message) + "\r\n");
+}
+
+void Server::setAway(Client *client, const std::string &message)
+{
+    client->setAway(message);
+
+    std::set<Client *> recipients;
+    const std::vector<Channel *> &joined = client->getChannels();
+    for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
+    {
+        const std::set<Client *> &watchers = (*it)->getAwayNotify();
+        recipients.insert(watchers.begin(), watchers.end());
+    }
+    recipients.erase(client);
+    if (recipients.empty())
+        return;
+
+    std::string line = ":" + client->getNickname() + "!user@localhost AWAY" + (message.empty() ? "" : " :" + message) + "\r\n";
+    for (std::set<Client *>::iterator it = recipients.begin(); it != recipients.end(); ++it)
+        (*it)->sendMessage(line);
+}
+
+void Server::sendAwayJoin(Channel *channel, Client *client)
+{
+    if (!client->isAway())
+        return;
+    std::string line = ":" + client->getNickname() + "!user@localhost AWAY :" + client->getAway() + "\r\n";
+    const std::set<Client *> &watchers = channel->getAwayNotify();
+    for (std::set<Client *>::const_iterator it = watchers.begin(); it != watchers.end(); ++it)
+    {
+        if (*it != client)
+            (*it)->sendMessage(line);
+    }
+}
+
+void Server::sendAwayReply(Client *client, Client *target)
+{
+    long long now = currentTimeMs();
+    std::string folded = foldNick(target->getNickname());
+    std::map<std::string, long long> &replied = client->_awayReplied;
+    std::map<std::string, long long>::iterator last = replied.find(folded);
+    if (last != replied.end() && now - last->second < AWAY_REPLY_INTERVAL)
+        return;
+
+    if (last == replied.end() && replied.size() >= AWAY_REPLY_TARGETS)
+    {
+        std::map<std::string, long long>::iterator oldest = replied.begin();
+        for (std::map<std::string, long long>::iterator it = replied.begin(); it != replied.end(); ++it)
+        {
+            if (it->second < oldest->second)
+                oldest = it;
+        }
+        replied.erase(oldest);
+    }
+    replied[folded] = now;
+    client->sendMessage(":localhost 301 " + client->getNickname() + " " + target->getNickname() + " :" + target->getAway() + "\r\n");
+}
@@ -2,6 +2,7 @@
 
 #include "Client.hpp"
 #include "Channel.hpp"
+#include "Metrics.hpp"
 #include <iostream>
 #include <stdlib.h>
 #include <algorithm>
@@ -28,22 +29,59 @@ static bool isValidNick(const std::string &n)
 
 void Server::processCommand(Client *client, const std::string &command)
 {
-    std::vector<std::string> args = splitCommand(command);
+    if (client->isServer())
+    {
+        flushJoins();
+        processLinkCommand(client, command);
+        return;
+    }
+
+    size_t offset = 0;
+    _clientTags.clear();
+    if (command[0] == '@')
+    {
+        offset = command.find(' ');
+        if (offset == std::string::npos)
+            return;
+
+        size_t pos = 1;
+        while (pos < offset)
+        {
+            size_t end = command.find(';', pos);
+            if (end == std::string::npos || end > offset)
+                end = offset;
+            if (command[pos] == '+' && end > pos + 1)
+            {
+                if (!_clientTags.empty())
+                    _clientTags += ";";
+                _clientTags.append(command, pos, end - pos);
+            }
+            pos = end + 1;
+        }
+        ++offset;
+    }
+
+    std::vector<std::string> args = splitCommand(command, offset);
     if (args.empty())
         return;
 
     std::string cmd = args[0];
     std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    if (cmd != "JOIN")
+        flushJoins();
 
     
     
-    if (cmd != "PASS" && cmd != "CAP" && cmd != "PING" && cmd != "NOTICE" && cmd != "QUIT"
+    if (cmd != "PASS" && cmd != "CAP" && cmd != "PING" && cmd != "NOTICE" && cmd != "QUIT" && cmd != "SERVER"
         && !_password.empty() && !client->isAuthenticated())
     {
         client->sendMessage(":localhost 464 * :Password required\r\n");
         return;
     }
 
+    unsigned long long started = Metrics::nowUsec();
+    bool known = true;
+
     if (cmd == "PASS")
     {
         handlePass(client, args);
@@ -104,11 +142,78 @@ void Server::processCommand(Client *client, const std::string &command)
     {
         handleWho(client, args);
     }
+    else if (cmd == "CHATHISTORY")
+    {
+        handleChathistory(client, args);
+    }
+    else if (cmd == "TAGMSG")
+    {
+        handleTagmsg(client, args);
+    }
+    else if (cmd == "OPER")
+    {
+        handleOper(client, args);
+    }
+    else if (cmd == "STATS")
+    {
+        handleStats(client, args);
+    }
+    else if (cmd == "SERVER")
+    {
+        handleServer(client, args);
+    }
+    else if (cmd == "CONNECT")
+    {
+        handleConnect(client, args);
+    }
+    else if (cmd == "LIST")
+    {
+        handleList(client, args);
+    }
+    else if (cmd == "WHOIS")
+    {
+        handleWhois(client, args);
+    }
+    else if (cmd == "WHOWAS")
+    {
+        handleWhowas(client, args);
+    }
+    else if (cmd == "ISON")
+    {
+        handleIson(client, args);
+    }
+    else if (cmd == "MONITOR")
+    {
+        handleMonitor(client, args);
+    }
+    else if (cmd == "AWAY")
+    {
+        handleAway(client, args);
+    }
+    else if (cmd == "SILENCE")
+    {
+        handleSilence(client, args);
+    }
+    else if (cmd == "ACCEPT")
+    {
+        handleAccept(client, args);
+    }
+    else if (cmd == "MOTD")
+    {
+        handleMotd(client, args);
+    }
+    else if (cmd == "REHASH")
+    {
+        handleRehash(client, args);
+    }
     else
     {
         
         client->sendMessage(":localhost 421 * " + cmd + " :Unknown command\r\n");
+        known = false;
     }
+
+    g_metrics.recordCommand(known ? cmd : "UNKNOWN", Metrics::nowUsec() - started);
 }
 
 
@@ -153,7 +258,8 @@ void Server::handleNick(Client *client, const std::vector<std::string> &args)
     }
 
     
-    if (findClientByNickname(nickname))
+    Client *existing = findClientByNickname(nickname);
+    if (existing && (existing != client || nickname == client->getNickname()))
     {
         
         if (!client->isRegistered())
@@ -190,11 +296,19 @@ void Server::handleNick(Client *client, const std::vector<std::string> &args)
     
     if (!oldNick.empty())
     {
-        _clients_by_nick.erase(oldNick);
+        recordWhowas(client);
+        _clients_by_nick.erase(foldNick(oldNick));
     }
 
     client->setNickname(nickname);
-    _clients_by_nick[nickname] = client;
+    client->setNickTs(currentTimeMs() / 1000);
+    _clients_by_nick[foldNick(nickname)] = client;
+    _users.rename(client, foldNick(nickname));
+    if (client->isRegistered() && !oldNick.empty())
+    {
+        notifyMonitors(oldNick, NULL);
+        notifyMonitors(nickname, client);
+    }
 
     if (client->isRegistered() && !oldNick.empty())
     {
@@ -202,36 +316,38 @@ void Server::handleNick(Client *client, const std::vector<std::string> &args)
         std::string nickMsg = ":" + oldNick + "!user@localhost NICK :" + nickname + "\r\n";
         client->sendMessage(nickMsg);
 
+        std::ostringstream nickTs;
+        nickTs << client->getNickTs();
+        sendToLinks(":" + oldNick + " NICK " + nickname + " " + nickTs.str() + "\r\n");
+
         
         std::vector<Channel *> channelsToLeave;
-        for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+        const std::vector<Channel *> &joined = client->getChannels();
+        for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
         {
-            Channel *channel = it->second;
-            if (channel->hasClient(client))
+            Channel *channel = *it;
+            
+            std::vector<std::string> banList = channel->getBanList();
+            bool isBanned = false;
+            for (std::vector<std::string>::iterator banIt = banList.begin(); banIt != banList.end(); ++banIt)
             {
-                
-                std::vector<std::string> banList = channel->getBanList();
-                bool isBanned = false;
-                for (std::vector<std::string>::iterator banIt = banList.begin(); banIt != banList.end(); ++banIt)
+                std::string banMask = *banIt;
+                if (banMask == nickname || banMask == nickname + "!*@*")
                 {
-                    std::string banMask = *banIt;
-                    if (banMask == nickname || banMask == nickname + "!*@*")
-                    {
-                        isBanned = true;
-                        break;
-                    }
+                    isBanned = true;
+                    break;
                 }
+            }
 
-                if (isBanned)
-                {
-                    
-                    channelsToLeave.push_back(channel);
-                }
-                else
-                {
-                    
-                    channel->broadcast(nickMsg);
-                }
+            if (isBanned)
+            {
+                
+                channelsToLeave.push_back(channel);
+            }
+            else
+            {
+                
+                channel->broadcast(nickMsg);
             }
         }
 
@@ -241,12 +357,13 @@ void Server::handleNick(Client *client, const std::vector<std::string> &args)
             Channel *channel = *it;
             std::string kickMsg = ":localhost KICK " + channel->getName() + " " + nickname + " :Banned nickname\r\n";
             channel->broadcast(kickMsg);
+            sendToLinks(":" + _serverName + " KICK " + channel->getName() + " " + nickname + " :Banned nickname\r\n");
 
             bool wasOperator = channel->isOperator(client);
             channel->removeClient(client);
 
             
-            if (wasOperator && !channel->getClients().empty())
+            if (wasOperator && channel->getClientCount() > 0)
             {
                 channel->promoteNextOperator();
             }
@@ -257,6 +374,13 @@ void Server::handleNick(Client *client, const std::vector<std::string> &args)
         
         
         sendWelcome(client);
+        introduceClient(client);
+        _users.insert(client, foldNick(client->getNickname()), userFlags(client));
+        notifyMonitors(client->getNickname(), client);
+    }
+    else
+    {
+        completeRegistration(client);
     }
 
     
@@ -274,133 +398,18 @@ void Server::handleUser(Client *client, const std::vector<std::string> &args)
         return;
     }
 
-    client->setUsername(args[1]);
-    client->setRealname(args[4]);
-    client->setRegistered(true);
-
-    if (!client->getNickname().empty())
-    {
-        sendWelcome(client);
-    }
-}
-
-
-
-void Server::handleJoin(Client *client, const std::vector<std::string> &args)
-{
-    if (!client->isRegistered())
-    {
-        client->sendMessage(":localhost 451 * :You have not registered\r\n");
-        return;
-    }
-
-    if (args.size() < 2)
-    {
-        client->sendMessage(":localhost 461 * JOIN :Not enough parameters\r\n");
-        return;
-    }
-
-    std::string channelName = args[1];
-    if (channelName[0] != '#')
-    {
-        client->sendMessage(":localhost 403 * " + channelName + " :Invalid channel name\r\n");
-        return;
-    }
-
-    
-    std::string key = (args.size() > 2) ? args[2] : "";
-
-    Channel *channel = findChannel(channelName);
-    if (!channel)
-    {
-        channel = createChannel(channelName);
-        
-        channel->addOperator(client);
-    }
-
-    
-    std::string nickname = client->getNickname();
-    std::vector<std::string> banList = channel->getBanList();
-    for (std::vector<std::string>::iterator it = banList.begin(); it != banList.end(); ++it)
+    if (client->isRegistered())
     {
-        std::string banMask = *it;
-        
-        if (banMask == nickname || banMask == nickname + "!*@*")
-        {
-            client->sendMessage(":localhost 474 " + nickname + " " + channelName + " :Cannot join channel (+b)\r\n");
-            return;
-        }
-    }
-
-    
-    if (!channel->getKey().empty() && channel->getKey() != key)
-    {
-        client->sendMessage(":localhost 475 * " + channelName + " :Cannot join channel (+k)\r\n");
+        client->sendMessage(":localhost 462 " + client->getNickname() + " :You may not reregister\r\n");
         return;
     }
 
-    
-    if (channel->isInviteOnly())
-    {
-        if (!channel->isInvited(nickname))
-        {
-            client->sendMessage(":localhost 473 " + nickname + " " + channelName + " :Cannot join channel (+i)\r\n");
-            return;
-        }
-    }
-
-    
-    if (channel->getUserLimit() > 0)
-    {
-        std::vector<Client *> clients = channel->getClients();
-        if (clients.size() >= static_cast<size_t>(channel->getUserLimit()))
-        {
-            client->sendMessage(":localhost 471 " + nickname + " " + channelName + " :Cannot join channel (+l)\r\n");
-            return;
-        }
-    }
-
-    
-    if (channel->hasClient(client))
-    {
-        return; 
-    }
-
-    channel->addClient(client);
-
-    
-    std::string joinMsg = ":" + nickname + "!user@localhost JOIN " + channelName + "\r\n";
-    channel->broadcast(joinMsg);
-
-    
-    if (channel->getTopic().empty())
-    {
-        client->sendMessage(":localhost 331 " + nickname + " " + channelName + " :No topic is set\r\n");
-    }
-    else
-    {
-        client->sendMessage(":localhost 332 " + nickname + " " + channelName + " :" + channel->getTopic() + "\r\n");
-    }
+    client->setUsername(args[1]);
+    client->setRealname(args[4][0] == ':' ? args[4].substr(1) : args[4]);
+    completeRegistration(client);
+}
 
-    
-    std::string namesList = "";
-    std::vector<Client *> clients = channel->getClients();
-    for (std::vector<Client *>::iterator it = clients.begin(); it != clients.end(); ++it)
-    {
-        if (!namesList.empty())
-            namesList += " ";
-        std::string prefix = channel->isOperator(*it) ? "@" : "";
-        namesList += prefix + (*it)->getNickname();
-    }
-    client->sendMessage(":localhost 353 " + nickname + " = " + channelName + " :" + namesList + "\r\n");
-    client->sendMessage(":localhost 366 " + nickname + " " + channelName + " :End of /NAMES list\r\n");
 
-    
-    if (channel->isInvited(nickname))
-    {
-        channel->removeInvitation(nickname);
-    }
-}
 
 void Server::handlePart(Client *client, const std::vector<std::string> &args)
 {
@@ -439,18 +448,19 @@ void Server::handlePart(Client *client, const std::vector<std::string> &args)
     partMsg += "\r\n";
 
     channel->broadcast(partMsg);
+    sendToLinks(partMsg);
 
     bool wasOperator = channel->isOperator(client);
     channel->removeClient(client);
 
     
-    if (wasOperator && !channel->hasOperators() && !channel->getClients().empty())
+    if (wasOperator && !channel->hasOperators() && channel->getClientCount() > 0)
     {
         channel->promoteNextOperator();
     }
 
     
-    if (channel->getClients().empty())
+    if (channel->getClientCount() == 0)
     {
         std::cout << "Channel " << channelName << " is empty, deleting..." << std::endl;
         _channels.erase(channelName);
@@ -458,77 +468,6 @@ void Server::handlePart(Client *client, const std::vector<std::string> &args)
     }
 }
 
-void Server::handlePrivmsg(Client *client, const std::vector<std::string> &args)
-{
-    if (args.size() < 3)
-    {
-        client->sendMessage(":localhost 461 * PRIVMSG :Not enough parameters\r\n");
-        return;
-    }
-
-    std::string target = args[1];
-
-    
-    std::string message;
-    if (args.size() >= 3)
-    {
-        
-        for (size_t i = 2; i < args.size(); ++i)
-        {
-            std::string part = args[i];
-            if (i == 2 && !part.empty() && part[0] == ':')
-                part = part.substr(1);
-            if (!message.empty()) message += " ";
-            message += part;
-        }
-    }
-
-    
-    if (message.empty())
-    {
-        client->sendMessage(":localhost 412 * :No text to send\r\n");
-        return;
-    }
-
-    if (target[0] == '#')
-    {
-        
-        Channel *channel = findChannel(target);
-        if (!channel)
-        {
-            client->sendMessage(":localhost 403 * " + target + " :No such channel\r\n");
-            return;
-        }
-
-        if (!channel->hasClient(client))
-        {
-            client->sendMessage(":localhost 404 * " + target + " :Cannot send to channel\r\n");
-            return;
-        }
-
-        std::string nickname = client->getNickname();
-        std::string privmsg = ":" + nickname + "!user@localhost PRIVMSG " + target + " :" + message + "\r\n";
-        channel->broadcast(privmsg, client);
-    }
-    else
-    {
-        
-        Client *targetClient = findClientByNickname(target);
-        if (!targetClient)
-        {
-            
-            client->sendMessage(":localhost 401 " + client->getNickname() + " " + target + " :No such nick/channel\r\n");
-            return;
-        }
-
-        std::string nickname = client->getNickname();
-        std::string privmsg = ":" + nickname + "!user@localhost PRIVMSG " + target + " :" + message + "\r\n";
-
-        
-        targetClient->sendMessage(privmsg);
-    }
-}
-
 void Server::handleKick(Client *client, const std::vector<std::string> &args)
 {
     if (args.size() < 3)
@@ -583,12 +522,13 @@ void Server::handleKick(Client *client, const std::vector<std::string> &args)
     std::string nickname = client->getNickname();
     std::string kickMsg = ":" + nickname + "!user@localhost KICK " + channelName + " " + targetNick + " :" + reason + "\r\n";
     channel->broadcast(kickMsg);
+    sendToLinks(kickMsg);
 
     bool wasOperator = channel->isOperator(targetClient);
     channel->removeClient(targetClient);
 
     
-    if (wasOperator && !channel->hasOperators() && !channel->getClients().empty())
+    if (wasOperator && !channel->hasOperators() && channel->getClientCount() > 0)
     {
         channel->promoteNextOperator();
     }
@@ -633,7 +573,10 @@ void Server::handleInvite(Client *client, const std::vector<std::string> &args)
 
     std::string nickname = client->getNickname();
     std::string inviteMsg = ":" + nickname + "!user@localhost INVITE " + targetNick + " " + channelName + "\r\n";
-    targetClient->sendMessage(inviteMsg);
+    if (targetClient->getUplink())
+        targetClient->getUplink()->sendMessage(inviteMsg);
+    else
+        targetClient->sendMessage(inviteMsg);
     client->sendMessage(":localhost 341 " + nickname + " " + targetNick + " " + channelName + "\r\n");
     channel->addInvitation(targetNick);
 }
@@ -669,12 +612,7 @@ void Server::handleTopic(Client *client, const std::vector<std::string> &args)
     {
         
         
-        std::vector<Channel*> joined;
-        for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
-        {
-            if (it->second->hasClient(client))
-                joined.push_back(it->second);
-        }
+        const std::vector<Channel *> &joined = client->getChannels();
 
         if (joined.empty())
         {
@@ -781,473 +719,230 @@ void Server::handleTopic(Client *client, const std::vector<std::string> &args)
         channel->setTopic(topic);
         std::string nickname = client->getNickname();
         std::string topicMsg = ":" + nickname + "!user@localhost TOPIC " + channelName + " :" + topic + "\r\n";
-        channel->broadcast(topicMsg);
+        long long time;
+        std::string msgid;
+        std::string tags = messageTags(time, msgid);
+        channel->broadcast(topicMsg, NULL, tags);
+        channel->addHistory(time, msgid, "@" + tags + " " + topicMsg);
+        sendToLinks(topicMsg);
     }
 }
 
-void Server::handleMode(Client *client, const std::vector<std::string> &args)
+void Server::handleQuit(Client *client, const std::vector<std::string> &args)
 {
+    std::string message = args.size() > 1 ? args[1] : "Leaving";
     
-    if (args.size() < 2)
-    {
-        client->sendMessage(":localhost 461 * MODE :Not enough parameters\r\n");
-        return;
-    }
-
-    std::string target = args[1];
+    if (!message.empty() && message[0] == ':')
+        message = message.substr(1);
+    std::string nickname = client->getNickname();
 
-    
-    if (target.empty() || target[0] != '#')
+    if (!nickname.empty())
     {
-        client->sendMessage(":localhost 461 * MODE :Channel name required (use: MODE #channel +/-modes)\r\n");
-        return;
-    }
+        std::string quitMsg = ":" + nickname + "!user@localhost QUIT :" + message + "\r\n";
 
-    if (target[0] == '#')
-    {
         
-        Channel *channel = findChannel(target);
-        if (!channel)
+        const std::vector<Channel *> &joined = client->getChannels();
+        for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
         {
-            client->sendMessage(":localhost 403 * " + target + " :No such channel\r\n");
-            return;
+            (*it)->broadcast(quitMsg);
         }
+    }
 
-        if (args.size() == 2)
-        {
-            
-            std::string nickname = client->getNickname();
-            std::string modes = "+";
-            std::string modeParams = "";
-            std::ostringstream oss;
-            oss << channel->getUserLimit();
-
-            if (channel->isInviteOnly())
-                modes += "i";
-            if (channel->isTopicRestricted())
-                modes += "t";
-            if (!channel->getKey().empty())
-            {
-                modes += "k";
-                
-                if (channel->hasClient(client))
-                    modeParams += " " + channel->getKey();
-            }
-            if (channel->getUserLimit() > 0)
-            {
-                modes += "l";
-                modeParams += " " + oss.str();
-            }
-
-            client->sendMessage(":localhost 324 " + nickname + " " + target + " " + modes + modeParams + "\r\n");
-            return;
-        }
+    removeClient(client, message);
+}
 
-        if (args.size() == 3 && args[2] == "b")
-        {
-            
-            std::string nickname = client->getNickname();
-            std::vector<std::string> banList = channel->getBanList();
-            for (std::vector<std::string>::iterator it = banList.begin(); it != banList.end(); ++it)
-            {
-                client->sendMessage(":localhost 367 " + nickname + " " + target + " " + *it + " localhost 0\r\n");
-            }
-            client->sendMessage(":localhost 368 " + nickname + " " + target + " :End of channel ban list\r\n");
-            return;
-        }
+static const struct
+{
+    const char *name;
+    unsigned int flag;
+} g_capabilities[] = {
+    {"message-tags", CAP_MESSAGE_TAGS},
+    {"server-time", CAP_SERVER_TIME},
+    {"echo-message", CAP_ECHO_MESSAGE},
+    {"batch", CAP_BATCH},
+    {"away-notify", CAP_AWAY_NOTIFY}
+};
+
+static const size_t g_capabilityCount = sizeof(g_capabilities) / sizeof(g_capabilities[0]);
+
+static unsigned int findCapability(const std::string &name)
+{
+    for (size_t i = 0; i < g_capabilityCount; ++i)
+    {
+        if (name == g_capabilities[i].name)
+            return g_capabilities[i].flag;
     }
+    return 0;
+}
 
-    if (args.size() < 3)
+void Server::handleCap(Client *client, const std::vector<std::string> &args)
+{
+    if (args.size() < 2)
     {
-        return; 
+        client->sendMessage(":localhost 461 * CAP :Not enough parameters\r\n");
+        return;
     }
 
-    std::string modes = args[2];
+    std::string subcommand = args[1];
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+    std::string nickname = client->getNickname().empty() ? "*" : client->getNickname();
 
-    if (target[0] == '#')
+    if (subcommand == "LS" || subcommand == "LIST")
     {
-        
-        Channel *channel = findChannel(target);
-        if (!channel)
-        {
-            client->sendMessage(":localhost 403 * " + target + " :No such channel\r\n");
-            return;
-        }
-
-        if (!channel->isOperator(client))
-        {
-            client->sendMessage(":localhost 482 * " + target + " :You're not channel operator\r\n");
-            return;
-        }
+        if (subcommand == "LS" && !client->isRegistered())
+            client->setCapNegotiating(true);
 
-        
-        bool setting = true; 
-
-        for (size_t i = 0; i < modes.length(); ++i)
+        std::vector<std::string> lines(1);
+        for (size_t i = 0; i < g_capabilityCount; ++i)
         {
-            char mode = modes[i];
-
-            if (mode == '+')
-            {
-                setting = true;
-                continue;
-            }
-            else if (mode == '-')
-            {
-                setting = false;
+            if (subcommand == "LIST" && !client->hasCap(g_capabilities[i].flag))
                 continue;
-            }
-
-            if (mode == 'b')
-            {
-                if (args.size() > 3)
-                {
-                    std::string banMask = args[3];
-                    if (setting)
-                    {
-                        
-                        std::string nickname = client->getNickname();
-                        if (banMask == nickname || banMask == nickname + "!*@*")
-                        {
-                            client->sendMessage(":localhost 485 * " + target + " :You cannot ban yourself\r\n");
-                            continue;
-                        }
-
-                        
-                        if (banMask == "*!*@localhost" || banMask == "*!*@*" || banMask == "*")
-                        {
-                            client->sendMessage(":localhost 486 * " + target + " :Ban mask too broad - would ban everyone\r\n");
-                            continue;
-                        }
-
-                        channel->addBan(banMask);
-                        std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + " +b " + banMask + "\r\n";
-                        channel->broadcast(modeMsg);
-
-                        
-                        
-                        Client *bannedClient = NULL;
-                        if (banMask.find("!") == std::string::npos && banMask.find("*") == std::string::npos)
-                        {
-                            
-                            bannedClient = findClientByNickname(banMask);
-                        }
-                        else if (banMask.length() > 4 && banMask.substr(banMask.length() - 4) == "!*@*")
-                        {
-                            
-                            std::string nickOnly = banMask.substr(0, banMask.length() - 4);
-                            bannedClient = findClientByNickname(nickOnly);
-                        }
-
-                        if (bannedClient && channel->hasClient(bannedClient))
-                        {
-                            
-                            std::string kickMsg = ":" + nickname + "!user@localhost KICK " + target + " " + banMask + " :Banned\r\n";
-                            channel->broadcast(kickMsg);
-
-                            
-                            bool wasOperator = channel->isOperator(bannedClient);
-                            channel->removeClient(bannedClient);
-
-                            
-                            if (wasOperator && !channel->getClients().empty())
-                            {
-                                channel->promoteNextOperator();
-                            }
-                        }
-                    }
-                    else
-                    {
-                        channel->removeBan(banMask);
-                        std::string nickname = client->getNickname();
-                        std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + " -b " + banMask + "\r\n";
-                        channel->broadcast(modeMsg);
-                    }
-                }
-            }
-            else if (mode == 'i')
-            {
-                channel->setInviteOnly(setting);
-                std::string nickname = client->getNickname();
-                std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + (setting ? " +i\r\n" : " -i\r\n");
-                channel->broadcast(modeMsg);
 
-                
-                std::cout << "[" << client->getFd() << "] MODE " << target << (setting ? " +i" : " -i") << " set by " << nickname << std::endl;
-            }
-            else if (mode == 't')
-            {
-                channel->setTopicRestricted(setting);
-                std::string nickname = client->getNickname();
-                std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + (setting ? " +t\r\n" : " -t\r\n");
-                channel->broadcast(modeMsg);
-
-                
-                std::cout << "[" << client->getFd() << "] MODE " << target << (setting ? " +t" : " -t") << " set by " << nickname << std::endl;
-            }
-            else if (mode == 'k')
-            {
-                std::string nickname = client->getNickname();
-                if (setting)
-                {
-                    if (args.size() <= 3 || args[3].empty())
-                    {
-                        client->sendMessage(":localhost 461 * MODE :Not enough parameters\r\n");
-                        continue;
-                    }
-                    const std::string &newKey = args[3];
-                    channel->setKey(newKey);
-                    
-                    std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + " +k " + newKey + "\r\n";
-                    channel->broadcast(modeMsg);
-                    std::cout << "[" << client->getFd() << "] MODE " << target << " +k " << newKey << " set by " << nickname << std::endl;
-                }
-                else
-                {
-                    
-                    if (args.size() <= 3)
-                    {
-                        client->sendMessage(":localhost 461 * MODE :Not enough parameters\r\n");
-                        continue;
-                    }
-                    const std::string &provided = args[3];
-                    if (provided != channel->getKey())
-                    {
-                        
-                        client->sendMessage(":localhost 525 * " + target + " :Key mismatch for -k\r\n");
-                        continue;
-                    }
-                    channel->setKey("");
-                    std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + " -k \r\n";
-                    channel->broadcast(modeMsg);
-                    std::cout << "[" << client->getFd() << "] MODE " << target << " -k set by " << nickname << std::endl;
-                }
-            }
-            else if (mode == 'l')
-            {
-                if (setting)
-                {
-                    if (args.size() <= 3)
-                    {
-                        
-                        client->sendMessage(":localhost 461 * MODE :Not enough parameters\r\n");
-                    }
-                    else
-                    {
-                        const std::string &limStr = args[3];
-                        char *endptr = NULL;
-                        long val = strtol(limStr.c_str(), &endptr, 10);
-                        if (limStr.empty() || *endptr != '\0' || val <= 0)
-                        {
-                            client->sendMessage(":localhost 461 * MODE :Invalid +l parameter (limit must be a positive integer > 0)\r\n");
-                        }
-                        else
-                        {
-                            int limit = static_cast<int>(val);
-                            channel->setUserLimit(limit);
-                            std::string nickname = client->getNickname();
-                            std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + " +l " + limStr + "\r\n";
-                            channel->broadcast(modeMsg);
-
-                            
-                            std::cout << "[" << client->getFd() << "] MODE " << target << " +l " << limStr << " set by " << nickname << std::endl;
-                        }
-                    }
-                }
-                else
-                {
-                    
-                    channel->setUserLimit(0);
-                    std::string nickname = client->getNickname();
-                    std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + " -l\r\n";
-                    channel->broadcast(modeMsg);
+            std::string name = g_capabilities[i].name;
+            if (lines.back().size() + name.size() + 1 > 400)
+                lines.push_back("");
+            if (!lines.back().empty())
+                lines.back() += " ";
+            lines.back() += name;
+        }
 
-                    
-                    std::cout << "[" << client->getFd() << "] MODE " << target << " -l set by " << nickname << std::endl;
-                }
-            }
-            else if (mode == 'o')
-            {
-                if (args.size() > 3)
-                {
-                    std::string targetNick = args[3];
-                    Client *targetClient = findClientByNickname(targetNick);
-                    if (targetClient && channel->hasClient(targetClient))
-                    {
-                        std::string nickname = client->getNickname();
-                        if (setting)
-                        {
-                            channel->addOperator(targetClient);
-                            std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + " +o " + targetNick + "\r\n";
-                            channel->broadcast(modeMsg);
-                        }
-                        else
-                        {
-                            channel->removeOperator(targetClient);
-                            std::string modeMsg = ":" + nickname + "!user@localhost MODE " + target + " -o " + targetNick + "\r\n";
-                            channel->broadcast(modeMsg);
-                        }
-                    }
-                }
-            }
+        bool multiline = subcommand == "LS" && args.size() > 2 && std::atoi(args[2].c_str()) >= 302;
+        std::string reply;
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            std::string more = (multiline && i + 1 < lines.size()) ? "* " : "";
+            reply += ":localhost CAP " + nickname + " " + subcommand + " " + more + ":" + lines[i] + "\r\n";
         }
+        client->sendMessage(reply);
     }
-}
-
-
+    else if (subcommand == "REQ")
+    {
+        if (!client->isRegistered())
+            client->setCapNegotiating(true);
 
-void Server::handleQuit(Client *client, const std::vector<std::string> &args)
-{
-    std::string message = args.size() > 1 ? args[1] : "Leaving";
-    
-    if (!message.empty() && message[0] == ':')
-        message = message.substr(1);
-    std::string nickname = client->getNickname();
+        std::string requested = (args.size() > 2) ? args[2] : "";
+        if (!requested.empty() && requested[0] == ':')
+            requested = requested.substr(1);
+        for (size_t i = 3; i < args.size(); ++i)
+            requested += " " + args[i];
 
-    if (!nickname.empty())
-    {
-        std::string quitMsg = ":" + nickname + "!user@localhost QUIT :" + message + "\r\n";
+        unsigned int caps = client->getCaps();
+        bool valid = !requested.empty();
+        std::istringstream iss(requested);
+        std::string name;
+        while (valid && iss >> name)
+        {
+            bool remove = (name[0] == '-');
+            unsigned int flag = findCapability(remove ? name.substr(1) : name);
+            if (!flag)
+                valid = false;
+            else if (remove)
+                caps &= ~flag;
+            else
+                caps |= flag;
+        }
 
-        
-        for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+        if (valid)
         {
-            if (it->second->hasClient(client))
+            if ((caps ^ client->getCaps()) & CAP_AWAY_NOTIFY)
             {
-                it->second->broadcast(quitMsg);
+                const std::vector<Channel *> &joined = client->getChannels();
+                for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
+                    (*it)->setAwayNotify(client, caps & CAP_AWAY_NOTIFY);
             }
+            client->setCaps(caps);
+            client->sendMessage(":localhost CAP " + nickname + " ACK :" + requested + "\r\n");
+        }
+        else
+        {
+            client->sendMessage(":localhost CAP " + nickname + " NAK :" + requested + "\r\n");
         }
-    }
-
-    removeClient(client);
-}
-
-void Server::handleCap(Client *client, const std::vector<std::string> &args)
-{
-    if (args.size() < 2)
-        return;
-
-    std::string subcommand = args[1];
-    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
-
-    if (subcommand == "LS")
-    {
-        
-        client->sendMessage(":localhost CAP * LS :\r\n");
-        client->sendMessage(":localhost CAP * END\r\n");
     }
     else if (subcommand == "END")
     {
-        
-        
-    }
-    else if (subcommand == "REQ")
-    {
-        
-        if (args.size() > 2)
+        if (client->isCapNegotiating())
         {
-            client->sendMessage(":localhost CAP * NAK :" + args[2] + "\r\n");
+            client->setCapNegotiating(false);
+            completeRegistration(client);
         }
     }
-}
-
-void Server::handlePing(Client *client, const std::vector<std::string> &args)
-{
-    if (args.size() < 2)
+    else
     {
-        client->sendMessage(":localhost 461 * PING :Not enough parameters\r\n");
-        return;
+        client->sendMessage(":localhost 410 " + nickname + " " + args[1] + " :Invalid CAP command\r\n");
     }
-
-    
-    std::string target = args[1];
-    client->sendMessage(":localhost PONG localhost :" + target + "\r\n");
 }
 
-void Server::handleNotice(Client *client, const std::vector<std::string> &args)
+void Server::handleTagmsg(Client *client, const std::vector<std::string> &args)
 {
-    
-    
-    if (args.size() >= 3)
+    if (!client->isRegistered())
     {
-        std::cout << "[" << client->getFd() << "] NOTICE: " << args[1] << " -> " << args[2] << std::endl;
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
     }
-}
 
-void Server::handleWho(Client *client, const std::vector<std::string> &args)
-{
     if (args.size() < 2)
     {
-        client->sendMessage(":localhost 461 * WHO :Not enough parameters\r\n");
+        client->sendMessage(":localhost 461 * TAGMSG :Not enough parameters\r\n");
         return;
     }
 
+    if (_clientTags.empty())
+        return;
+
     std::string target = args[1];
-    std::string nickname = client->getNickname();
+    std::vector<Client *> recipients;
 
     if (target[0] == '#')
     {
-        
         Channel *channel = findChannel(target);
         if (!channel)
         {
             client->sendMessage(":localhost 403 * " + target + " :No such channel\r\n");
             return;
         }
-
-        if (!channel->hasClient(client))
+        if (!channel->canSend(client))
         {
-            client->sendMessage(":localhost 442 * " + target + " :You're not on that channel\r\n");
+            client->sendMessage(":localhost 404 * " + target + " :Cannot send to channel\r\n");
             return;
         }
-
-        
-        std::vector<Client *> clients = channel->getClients();
-        for (std::vector<Client *>::iterator it = clients.begin(); it != clients.end(); ++it)
-        {
-            std::string targetNick = (*it)->getNickname();
-            std::string username = (*it)->getUsername();
-            std::string realname = (*it)->getRealname();
-
-            
-            if (username.empty())
-                username = "user";
-            if (realname.empty())
-                realname = targetNick;
-
-            std::string prefix = channel->isOperator(*it) ? "@" : "";
-            std::string flags = "H" + prefix; 
-
-            
-            client->sendMessage(":localhost 352 " + nickname + " " + target + " " + username + " localhost localhost " + targetNick + " " + flags + " :0 " + realname + "\r\n");
-            
-        }
-        client->sendMessage(":localhost 315 " + nickname + " " + target + " :End of /WHO list\r\n");
-        
+        recipients = channel->getClients();
     }
     else
     {
-        
         Client *targetClient = findClientByNickname(target);
         if (!targetClient)
         {
-            client->sendMessage(":localhost 401 * " + target + " :No such nick/channel\r\n");
+            client->sendMessage(":localhost 401 " + client->getNickname() + " " + target + " :No such nick/channel\r\n");
             return;
         }
+        if (!acceptsPrivate(targetClient, client, false))
+            return;
+        recipients.push_back(targetClient);
+        recipients.push_back(client);
+    }
 
-        std::string targetNick = targetClient->getNickname();
-        std::string username = targetClient->getUsername();
-        std::string realname = targetClient->getRealname();
-
-        
-        if (username.empty())
-            username = "user";
-        if (realname.empty())
-            realname = targetNick;
+    long long time;
+    std::string msgid;
+    std::string tagmsg = "@" + messageTags(time, msgid) + " :" + client->getNickname() + "!user@localhost TAGMSG " + target + "\r\n";
+    for (std::vector<Client *>::iterator it = recipients.begin(); it != recipients.end(); ++it)
+    {
+        if (!(*it)->hasCap(CAP_MESSAGE_TAGS))
+            continue;
+        if (*it == client && !client->hasCap(CAP_ECHO_MESSAGE))
+            continue;
+        (*it)->sendMessage(tagmsg);
+    }
+}
 
-        
-        client->sendMessage(":localhost 352 " + nickname + " * " + username + " localhost localhost " + targetNick + " H :0 " + realname + "\r\n");
-        std::cout << "[WHO] Sent: :localhost 352 " << nickname << " * " << username << " localhost localhost " << targetNick << " H :0 " << realname << std::endl;
-        client->sendMessage(":localhost 315 " + nickname + " " + target + " :End of /WHO list\r\n");
-        std::cout << "[WHO] Sent: :localhost 315 " << nickname << " " << target << " :End of /WHO list" << std::endl;
+void Server::handlePing(Client *client, const std::vector<std::string> &args)
+{
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 461 * PING :Not enough parameters\r\n");
+        return;
     }
+
+    
+    std::string target = args[1];
+    client->sendMessage(":localhost PONG localhost :" + target + "\r\n");
 }
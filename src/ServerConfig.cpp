@@ -0,0 +1,105 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Tls.hpp"
+#include <iostream>
+
+void Server::configure(Config *config)
+{
+    if (!config->serverName.empty())
+        _serverName = config->serverName;
+    _listenSpecs = config->listen;
+    setMetricsSocket(config->metricsSocket);
+    setSnapshot(config->snapshotPath, config->snapshotInterval);
+    setTrace(config->tracePath);
+    if (!config->tlsCertificate.empty())
+        setTls(config->tlsCertificate, config->tlsKey);
+
+    delete _config;
+    _config = config;
+}
+
+bool Server::rehash(std::string &error)
+{
+    if (_config->path.empty())
+    {
+        error = "no configuration file";
+        return false;
+    }
+
+    Config *next = new Config();
+    next->applyEnvironment();
+    if (!next->load(_config->path, error))
+    {
+        delete next;
+        return false;
+    }
+    if ((next->tlsCertificate != _config->tlsCertificate || next->tlsKey != _config->tlsKey)
+        && !next->tlsCertificate.empty() && !setTls(next->tlsCertificate, next->tlsKey))
+    {
+        delete next;
+        error = "cannot load TLS certificate";
+        return false;
+    }
+
+    if (next->listen != _config->listen || next->serverName != _config->serverName
+        || next->metricsSocket != _config->metricsSocket || next->snapshotPath != _config->snapshotPath
+        || next->snapshotInterval != _config->snapshotInterval || next->fanoutThreads != _config->fanoutThreads)
+        std::cerr << "Rehash: listeners, server name, metrics, snapshot and fanout settings apply on restart" << std::endl;
+
+    if (next->historyLimit != _config->historyLimit)
+    {
+        for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+            it->second->setHistoryLimit(next->historyLimit);
+    }
+
+    setTrace(next->tracePath);
+
+    const Config *previous = _config;
+    _config = next;
+    delete previous;
+    std::cout << "Rehashed " << _config->path << std::endl;
+    return true;
+}
+
+void Server::handleRehash(Client *client, const std::vector<std::string> &)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isOper())
+    {
+        client->sendMessage(":localhost 481 " + nickname + " :Permission Denied- You're not an IRC operator\r\n");
+        return;
+    }
+
+    std::string path = _config->path;
+    std::string error;
+    if (!rehash(error))
+    {
+        client->sendMessage(":localhost NOTICE " + nickname + " :Rehash failed: " + error + "\r\n");
+        return;
+    }
+    client->sendMessage(":localhost 382 " + nickname + " " + path + " :Rehashing\r\n");
+}
+
+void Server::handleMotd(Client *client, const std::vector<std::string> &)
+{
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+
+    std::string nickname = client->getNickname();
+    const std::vector<std::string> &motd = _config->motd;
+    if (motd.empty())
+    {
+        client->sendMessage(":localhost 422 " + nickname + " :MOTD File is missing\r\n");
+        return;
+    }
+
+    std::string reply = ":localhost 375 " + nickname + " :- localhost Message of the day - \r\n";
+    for (std::vector<std::string>::const_iterator it = motd.begin(); it != motd.end(); ++it)
+        reply += ":localhost 372 " + nickname + " :- " + *it + "\r\n";
+    reply += ":localhost 376 " + nickname + " :End of /MOTD command.\r\n";
+    client->sendMessage(reply);
+}
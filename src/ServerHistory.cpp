@@ -0,0 +1,145 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+static bool resolveReference(Channel *channel, const std::string &ref, bool after, size_t &index)
+{
+    size_t size = channel->getHistorySize();
+
+    if (ref.compare(0, 6, "msgid=") == 0)
+    {
+        std::string msgid = ref.substr(6);
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (channel->getHistoryEntry(i).msgid == msgid)
+            {
+                index = after ? i + 1 : i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    long long ms;
+    if (ref.compare(0, 10, "timestamp=") != 0 || !Server::parseServerTime(ref.substr(10), ms))
+        return false;
+
+    index = 0;
+    while (index < size)
+    {
+        long long time = channel->getHistoryEntry(index).time;
+        if (after ? time > ms : time >= ms)
+            break;
+        ++index;
+    }
+    return true;
+}
+
+void Server::handleChathistory(Client *client, const std::vector<std::string> &args)
+{
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+
+    if (args.size() < 5)
+    {
+        client->sendMessage(":localhost FAIL CHATHISTORY NEED_MORE_PARAMS :Missing parameters\r\n");
+        return;
+    }
+
+    std::string subcommand = args[1];
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+    const std::string &target = args[2];
+    const std::string &ref = args[3];
+
+    if (subcommand != "LATEST" && subcommand != "BEFORE" && subcommand != "AFTER")
+    {
+        client->sendMessage(":localhost FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " :Unknown subcommand\r\n");
+        return;
+    }
+
+    char *endptr = NULL;
+    long limit = strtol(args[4].c_str(), &endptr, 10);
+    if (args[4].empty() || *endptr != '\0' || limit <= 0)
+    {
+        client->sendMessage(":localhost FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " " + args[4] + " :Invalid limit\r\n");
+        return;
+    }
+
+    Channel *channel = findChannel(target);
+    if (!channel || !channel->hasClient(client))
+    {
+        client->sendMessage(":localhost FAIL CHATHISTORY INVALID_TARGET " + subcommand + " " + target + " :Messages could not be retrieved\r\n");
+        return;
+    }
+
+    size_t size = channel->getHistorySize();
+    size_t count = static_cast<size_t>(limit);
+    size_t begin = 0;
+    size_t end = size;
+    size_t index = 0;
+
+    if (subcommand == "LATEST" && ref == "*")
+    {
+        begin = (size > count) ? size - count : 0;
+    }
+    else if (!resolveReference(channel, ref, subcommand != "BEFORE", index))
+    {
+        if (ref.compare(0, 6, "msgid=") != 0)
+        {
+            client->sendMessage(":localhost FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " " + ref + " :Invalid message reference\r\n");
+            return;
+        }
+        begin = end = 0;
+    }
+    else if (subcommand == "BEFORE")
+    {
+        end = index;
+        begin = (end > count) ? end - count : 0;
+    }
+    else if (subcommand == "AFTER")
+    {
+        begin = index;
+        end = std::min(size, begin + count);
+    }
+    else
+    {
+        begin = std::max(index, (size > count) ? size - count : 0);
+    }
+
+    std::string batch;
+    std::string reply;
+    if (client->hasCap(CAP_BATCH))
+    {
+        batch = nextBatchRef();
+        reply = ":localhost BATCH +" + batch + " chathistory " + target + "\r\n";
+    }
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        const std::string &line = channel->getHistoryEntry(i).line;
+        if (client->hasCap(CAP_MESSAGE_TAGS))
+        {
+            if (!batch.empty())
+                reply += "@batch=" + batch + ";" + line.substr(1);
+            else
+                reply += line;
+        }
+        else
+        {
+            std::string body = line.substr(line.find(' ') + 1);
+            if (client->hasCap(CAP_SERVER_TIME))
+                reply += line.substr(0, line.find(';')) + " " + body;
+            else
+                reply += body;
+        }
+    }
+
+    if (!batch.empty())
+        reply += ":localhost BATCH -" + batch + "\r\n";
+    client->sendMessage(reply);
+}
@@ -0,0 +1,147 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include <sstream>
+
+void Server::handleJoin(Client *client, const std::vector<std::string> &args)
+{
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 461 * JOIN :Not enough parameters\r\n");
+        return;
+    }
+
+    std::stringstream names(args[1]);
+    std::stringstream keys(args.size() > 2 ? args[2] : "");
+    std::string name;
+    std::string key;
+    while (std::getline(names, name, ','))
+    {
+        if (!std::getline(keys, key, ','))
+            key.clear();
+        if (!name.empty())
+            joinChannel(client, name, key);
+    }
+}
+
+void Server::joinChannel(Client *client, const std::string &channelName, const std::string &key)
+{
+    if (channelName[0] != '#')
+    {
+        client->sendMessage(":localhost 403 * " + channelName + " :Invalid channel name\r\n");
+        return;
+    }
+
+    Channel *channel = findChannel(channelName);
+    if (!channel)
+        channel = createChannel(channelName);
+
+    std::string nickname = client->getNickname();
+    std::vector<std::string> banList = channel->getBanList();
+    for (std::vector<std::string>::iterator it = banList.begin(); it != banList.end(); ++it)
+    {
+        std::string banMask = *it;
+        if (banMask == nickname || banMask == nickname + "!*@*")
+        {
+            client->sendMessage(":localhost 474 " + nickname + " " + channelName + " :Cannot join channel (+b)\r\n");
+            return;
+        }
+    }
+
+    if (!channel->getKey().empty() && channel->getKey() != key)
+    {
+        client->sendMessage(":localhost 475 * " + channelName + " :Cannot join channel (+k)\r\n");
+        return;
+    }
+
+    if (channel->isInviteOnly())
+    {
+        if (!channel->isInvited(nickname))
+        {
+            client->sendMessage(":localhost 473 " + nickname + " " + channelName + " :Cannot join channel (+i)\r\n");
+            return;
+        }
+    }
+
+    if (channel->getUserLimit() > 0)
+    {
+        if (channel->getClientCount() >= static_cast<size_t>(channel->getUserLimit()))
+        {
+            client->sendMessage(":localhost 471 " + nickname + " " + channelName + " :Cannot join channel (+l)\r\n");
+            return;
+        }
+    }
+
+    if (channel->hasClient(client))
+    {
+        return;
+    }
+
+    channel->addClient(client);
+    if (!channel->hasOperators() && channel->getClientCount() == 1)
+    {
+        channel->addOperator(client);
+    }
+    if (channel->isInvited(nickname))
+    {
+        channel->removeInvitation(nickname);
+    }
+    _pendingJoins[channelName].push_back(client);
+}
+
+void Server::flushJoins()
+{
+    if (_pendingJoins.empty())
+        return;
+
+    std::map<std::string, std::vector<Client *> > pending;
+    pending.swap(_pendingJoins);
+    for (std::map<std::string, std::vector<Client *> >::iterator it = pending.begin(); it != pending.end(); ++it)
+    {
+        Channel *channel = findChannel(it->first);
+        if (!channel)
+            continue;
+
+        const std::string &name = it->first;
+        std::vector<Client *> &joiners = it->second;
+        std::string joins;
+        std::string members;
+        for (std::vector<Client *>::iterator joiner = joiners.begin(); joiner != joiners.end(); ++joiner)
+        {
+            joins += ":" + (*joiner)->getNickname() + "!user@localhost JOIN " + name + "\r\n";
+            if (!members.empty())
+                members += " ";
+            members += channel->getMemberPrefix(*joiner, true) + (*joiner)->getNickname();
+        }
+
+        channel->broadcast(joins);
+        sendToLinks(":" + _serverName + " SJOIN " + name + " " + channel->getModeString(true) + " :" + members + "\r\n");
+
+        std::string numeric = channel->getTopic().empty() ? " 331 " : " 332 ";
+        std::string topic = channel->getTopic().empty() ? " :No topic is set\r\n" : " :" + channel->getTopic() + "\r\n";
+        std::string namesList;
+        std::vector<Client *> clients = channel->getClients();
+        for (std::vector<Client *>::iterator member = clients.begin(); member != clients.end(); ++member)
+        {
+            if (!namesList.empty())
+                namesList += " ";
+            namesList += channel->getMemberPrefix(*member) + (*member)->getNickname();
+        }
+
+        for (std::vector<Client *>::iterator joiner = joiners.begin(); joiner != joiners.end(); ++joiner)
+        {
+            sendAwayJoin(channel, *joiner);
+            const std::string &nickname = (*joiner)->getNickname();
+            std::string reply = ":localhost" + numeric + nickname + " " + name + topic;
+            reply += ":localhost 353 " + nickname + " = " + name + " :" + namesList + "\r\n";
+            reply += ":localhost 366 " + nickname + " " + name + " :End of /NAMES list\r\n";
+            (*joiner)->sendMessage(reply);
+        }
+    }
+}
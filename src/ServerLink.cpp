@@ -0,0 +1,743 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Metrics.hpp"
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+static std::string stripColon(const std::string &arg)
+{
+    return (!arg.empty() && arg[0] == ':') ? arg.substr(1) : arg;
+}
+
+static std::string toString(long value)
+{
+    std::ostringstream oss;
+    oss << value;
+    return oss.str();
+}
+
+bool Server::connectLink(const std::string &host, int port)
+{
+    if (_config->linkPassword.empty())
+        return false;
+
+    LinkAttempt *attempt = new LinkAttempt();
+    attempt->host = host;
+    attempt->port = port;
+    attempt->service = toString(port);
+    attempt->status = 0;
+    attempt->result = NULL;
+    attempt->next = NULL;
+    attempt->fd = -1;
+    if (pipe(attempt->wake) < 0)
+    {
+        delete attempt;
+        return false;
+    }
+    if (attempt->wake[0] >= FD_SETSIZE || pthread_create(&attempt->resolver, NULL, &Server::resolveLink, attempt) != 0)
+    {
+        close(attempt->wake[0]);
+        close(attempt->wake[1]);
+        delete attempt;
+        return false;
+    }
+    fcntl(attempt->wake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(attempt->wake[1], F_SETFD, FD_CLOEXEC);
+    FD_SET(attempt->wake[0], &_master_set);
+    if (attempt->wake[0] > _fd_max)
+        _fd_max = attempt->wake[0];
+    _linkAttempts.push_back(attempt);
+    return true;
+}
+
+void *Server::resolveLink(void *arg)
+{
+    LinkAttempt *attempt = static_cast<LinkAttempt *>(arg);
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    attempt->status = getaddrinfo(attempt->host.c_str(), attempt->service.c_str(), &hints, &attempt->result);
+    attempt->next = attempt->status == 0 ? attempt->result : NULL;
+    char done = 1;
+    write(attempt->wake[1], &done, 1);
+    return NULL;
+}
+
+bool Server::startLinkConnect(LinkAttempt *attempt)
+{
+    for (; attempt->next; attempt->next = attempt->next->ai_next)
+    {
+        int fd = socket(attempt->next->ai_family, attempt->next->ai_socktype, attempt->next->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (fd >= FD_SETSIZE)
+        {
+            close(fd);
+            return false;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (connect(fd, attempt->next->ai_addr, attempt->next->ai_addrlen) == 0 || errno == EINPROGRESS)
+        {
+            attempt->fd = fd;
+            FD_SET(fd, &_master_set);
+            if (fd > _fd_max)
+                _fd_max = fd;
+            return true;
+        }
+        close(fd);
+    }
+    return false;
+}
+
+void Server::continueLinks(fd_set &write_fds)
+{
+    std::vector<LinkAttempt *> pending;
+    for (std::vector<LinkAttempt *>::iterator it = _linkAttempts.begin(); it != _linkAttempts.end(); ++it)
+    {
+        LinkAttempt *attempt = *it;
+        if (attempt->wake[0] >= 0)
+        {
+            if (!FD_ISSET(attempt->wake[0], &_read_fds))
+            {
+                pending.push_back(attempt);
+                continue;
+            }
+            FD_CLR(attempt->wake[0], &_read_fds);
+            pthread_join(attempt->resolver, NULL);
+            closeFd(attempt->wake[0]);
+            close(attempt->wake[1]);
+            attempt->wake[0] = -1;
+            if (attempt->status != 0)
+                std::cerr << "Link: cannot resolve " << attempt->host << std::endl;
+        }
+        else if (!FD_ISSET(attempt->fd, &write_fds))
+        {
+            pending.push_back(attempt);
+            continue;
+        }
+        else
+        {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(attempt->fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0)
+            {
+                finishLink(attempt);
+                freeaddrinfo(attempt->result);
+                delete attempt;
+                continue;
+            }
+            FD_CLR(attempt->fd, &_read_fds);
+            closeFd(attempt->fd);
+            attempt->fd = -1;
+            attempt->next = attempt->next->ai_next;
+        }
+
+        if (startLinkConnect(attempt))
+        {
+            pending.push_back(attempt);
+            continue;
+        }
+        if (attempt->status == 0)
+            std::cerr << "Link: cannot connect to " << attempt->host << ":" << attempt->port << std::endl;
+        if (attempt->result)
+            freeaddrinfo(attempt->result);
+        delete attempt;
+    }
+    _linkAttempts.swap(pending);
+}
+
+void Server::finishLink(LinkAttempt *attempt)
+{
+    int fd = attempt->fd;
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    Client *link = new Client(fd);
+    _clients[fd] = link;
+    _linkPeers[fd] = attempt->host + ":" + attempt->service;
+    g_metrics.connectionOpened();
+
+    std::cout << "Link: connected to " << attempt->host << ":" << attempt->port << " (fd " << fd << ")" << std::endl;
+    link->sendMessage("SERVER " + _serverName + " " + _config->linkPassword + " :ircserv\r\n");
+}
+
+void Server::retryAutoconnect()
+{
+    for (std::vector<std::pair<std::string, int> >::const_iterator it = _config->links.begin(); it != _config->links.end(); ++it)
+    {
+        std::string peer = it->first + ":" + toString(it->second);
+        bool linked = false;
+        for (std::map<int, std::string>::iterator link = _linkPeers.begin(); link != _linkPeers.end(); ++link)
+        {
+            if (link->second == peer)
+                linked = true;
+        }
+        for (std::vector<LinkAttempt *>::iterator attempt = _linkAttempts.begin(); attempt != _linkAttempts.end(); ++attempt)
+        {
+            if ((*attempt)->host == it->first && (*attempt)->port == it->second)
+                linked = true;
+        }
+        if (!linked)
+            connectLink(it->first, it->second);
+    }
+}
+
+void Server::handleConnect(Client *client, const std::vector<std::string> &args)
+{
+    if (!client->isOper())
+    {
+        client->sendMessage(":localhost 481 " + client->getNickname() + " :Permission Denied- You're not an IRC operator\r\n");
+        return;
+    }
+    if (args.size() < 3)
+    {
+        client->sendMessage(":localhost 461 " + client->getNickname() + " CONNECT :Not enough parameters\r\n");
+        return;
+    }
+
+    int port = std::atoi(args[2].c_str());
+    if (!connectLink(args[1], port))
+    {
+        client->sendMessage(":localhost NOTICE " + client->getNickname() + " :Could not link to " + args[1] + "\r\n");
+        return;
+    }
+    client->sendMessage(":localhost NOTICE " + client->getNickname() + " :Linking to " + args[1] + "\r\n");
+}
+
+void Server::handleServer(Client *client, const std::vector<std::string> &args)
+{
+    std::string error;
+    if (_config->linkPassword.empty())
+        error = "Linking is disabled";
+    else if (args.size() < 3 || client->isRegistered() || !client->getNickname().empty())
+        error = "Invalid SERVER handshake";
+    else if (args[2] != _config->linkPassword)
+        error = "Bad link password";
+    else if (args[1] == _serverName || _servers.count(args[1]))
+        error = "Server " + args[1] + " already exists";
+
+    if (!error.empty())
+    {
+        std::cout << "[" << client->getFd() << "] Link refused: " << error << std::endl;
+        client->sendMessage("ERROR :" + error + "\r\n");
+        client->flush();
+        removeClient(client, "");
+        return;
+    }
+
+    std::string name = args[1];
+    client->setServer(true);
+    client->setAuthenticated(true);
+    _servers[name] = client;
+
+    if (!_linkPeers.count(client->getFd()))
+        client->sendMessage("SERVER " + _serverName + " " + _config->linkPassword + " :ircserv\r\n");
+
+    std::cout << "Link: " << name << " established on fd " << client->getFd() << std::endl;
+    sendToLinks(":" + _serverName + " SERVER " + name + "\r\n", client);
+    sendBurst(client);
+}
+
+void Server::introduceClient(Client *client)
+{
+    std::string uid = ":" + _serverName + " UID " + client->getNickname() + " " + toString(client->getNickTs())
+        + " " + client->getUsername() + " :" + client->getRealname() + "\r\n";
+    sendToLinks(uid, client->getUplink());
+}
+
+void Server::sendBurst(Client *link)
+{
+    std::string burst;
+
+    for (std::map<std::string, Client *>::iterator it = _servers.begin(); it != _servers.end(); ++it)
+    {
+        if (it->second != link)
+            burst += ":" + _serverName + " SERVER " + it->first + "\r\n";
+    }
+
+    for (std::map<std::string, Client *>::iterator it = _clients_by_nick.begin(); it != _clients_by_nick.end(); ++it)
+    {
+        Client *client = it->second;
+        if (client->getUplink() == link || !client->isRegistered())
+            continue;
+        burst += ":" + originOf(client) + " UID " + client->getNickname() + " " + toString(client->getNickTs())
+            + " " + client->getUsername() + " :" + client->getRealname() + "\r\n";
+        if (client->isAway())
+            burst += ":" + client->getNickname() + " AWAY :" + client->getAway() + "\r\n";
+    }
+
+    for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+    {
+        Channel *channel = it->second;
+        std::string members;
+        std::vector<Client *> clients = channel->getClients();
+        for (std::vector<Client *>::iterator member = clients.begin(); member != clients.end(); ++member)
+        {
+            if ((*member)->getUplink() == link || !(*member)->isRegistered())
+                continue;
+            if (!members.empty())
+                members += " ";
+            members += channel->getMemberPrefix(*member, true) + (*member)->getNickname();
+        }
+        if (members.empty())
+            continue;
+
+        burst += ":" + _serverName + " SJOIN " + it->first + " " + channel->getModeString(true) + " :" + members + "\r\n";
+
+        if (!channel->getTopic().empty())
+            burst += ":" + _serverName + " TOPIC " + it->first + " :" + channel->getTopic() + "\r\n";
+        std::vector<std::string> bans = channel->getBanList();
+        for (std::vector<std::string>::iterator ban = bans.begin(); ban != bans.end(); ++ban)
+            burst += ":" + _serverName + " MODE " + it->first + " +b " + *ban + "\r\n";
+    }
+
+    burst += ":" + _serverName + " EOB\r\n";
+    link->sendMessage(burst);
+}
+
+void Server::splitLink(Client *link)
+{
+    std::string linkName;
+    for (std::map<std::string, Client *>::iterator it = _servers.begin(); it != _servers.end();)
+    {
+        if (it->second == link)
+        {
+            if (linkName.empty() || it->first.size() < linkName.size())
+                linkName = it->first;
+            _servers.erase(it++);
+        }
+        else
+            ++it;
+    }
+
+    std::vector<Client *> lost;
+    for (std::map<std::string, Client *>::iterator it = _clients_by_nick.begin(); it != _clients_by_nick.end(); ++it)
+    {
+        if (it->second->getUplink() == link)
+            lost.push_back(it->second);
+    }
+
+    std::string reason = _serverName + " " + (linkName.empty() ? "*" : linkName);
+    std::cout << "Link: lost " << reason << ", " << lost.size() << " users split" << std::endl;
+    for (std::vector<Client *>::iterator it = lost.begin(); it != lost.end(); ++it)
+    {
+        std::string quitMsg = ":" + (*it)->getNickname() + "!user@localhost QUIT :" + reason + "\r\n";
+        const std::vector<Channel *> &joined = (*it)->getChannels();
+        for (std::vector<Channel *>::const_iterator ch = joined.begin(); ch != joined.end(); ++ch)
+            (*ch)->broadcast(quitMsg, *it);
+        removeClient(*it, reason);
+    }
+}
+
+void Server::sendToLinks(const std::string &line, Client *except)
+{
+    std::vector<Client *> sent;
+    for (std::map<std::string, Client *>::iterator it = _servers.begin(); it != _servers.end(); ++it)
+    {
+        if (it->second == except || std::find(sent.begin(), sent.end(), it->second) != sent.end())
+            continue;
+        sent.push_back(it->second);
+        it->second->sendMessage(line);
+    }
+}
+
+void Server::sendToChannelLinks(Channel *channel, const std::string &line, Client *except)
+{
+    std::set<Client *> links;
+    std::vector<Client *> clients = channel->getClients();
+    for (std::vector<Client *>::iterator it = clients.begin(); it != clients.end(); ++it)
+    {
+        Client *uplink = (*it)->getUplink();
+        if (uplink && uplink != except && links.insert(uplink).second)
+            uplink->sendMessage(line);
+    }
+}
+
+void Server::killClient(Client *client, const std::string &reason)
+{
+    std::string nickname = client->getNickname();
+    sendToLinks(":" + _serverName + " KILL " + nickname + " " + toString(client->getNickTs()) + " :" + reason + "\r\n");
+
+    std::string quitMsg = ":" + nickname + "!user@localhost QUIT :Killed (" + reason + ")\r\n";
+    const std::vector<Channel *> &joined = client->getChannels();
+    for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
+        (*it)->broadcast(quitMsg, client);
+    if (!client->getUplink())
+    {
+        client->sendMessage("ERROR :Closing Link: " + nickname + " (Killed (" + reason + "))\r\n");
+        client->flush();
+    }
+    removeClient(client, "");
+}
+
+bool Server::resolveCollision(Client *link, const std::string &nickname, long ts, Client *source)
+{
+    Client *existing = findClientByNickname(nickname);
+    if (!existing || existing == source)
+        return true;
+
+    std::cout << "Link: nick collision on " << nickname << std::endl;
+    if (existing->getNickTs() > ts)
+    {
+        killClient(existing, "Nick collision");
+        return true;
+    }
+    if (existing->getNickTs() == ts)
+        killClient(existing, "Nick collision");
+    link->sendMessage(":" + _serverName + " KILL " + nickname + " " + toString(ts) + " :Nick collision\r\n");
+    return false;
+}
+
+void Server::dropMember(Channel *channel, Client *client)
+{
+    bool wasOperator = channel->isOperator(client);
+    channel->removeClient(client);
+
+    if (wasOperator && !channel->hasOperators() && channel->getClientCount() > 0)
+    {
+        channel->promoteNextOperator();
+    }
+
+    if (channel->getClientCount() == 0)
+    {
+        _channels.erase(channel->getName());
+        delete channel;
+    }
+}
+
+void Server::applyLinkModes(Channel *channel, const std::vector<std::string> &args, size_t index)
+{
+    if (index >= args.size())
+        return;
+
+    const std::string &modes = args[index];
+    size_t param = index + 1;
+    bool setting = true;
+
+    for (size_t i = 0; i < modes.size(); ++i)
+    {
+        char mode = modes[i];
+        if (mode == '+' || mode == '-')
+        {
+            setting = (mode == '+');
+            continue;
+        }
+
+        std::string value;
+        bool takesParam = (mode == 'k' || mode == 'o' || mode == 'v' || mode == 'b' || (mode == 'l' && setting));
+        if (takesParam && param < args.size())
+            value = stripColon(args[param++]);
+
+        if (mode == 'i')
+            channel->setMode(CHANNEL_INVITE_ONLY, setting);
+        else if (mode == 't')
+            channel->setMode(CHANNEL_TOPIC_LOCK, setting);
+        else if (mode == 'm')
+            channel->setMode(CHANNEL_MODERATED, setting);
+        else if (mode == 'n')
+            channel->setMode(CHANNEL_NO_EXTERNAL, setting);
+        else if (mode == 's')
+            channel->setMode(CHANNEL_SECRET, setting);
+        else if (mode == 'p')
+            channel->setMode(CHANNEL_PRIVATE, setting);
+        else if (mode == 'k')
+            channel->setKey(setting ? value : "");
+        else if (mode == 'l')
+            channel->setUserLimit(setting ? std::atoi(value.c_str()) : 0);
+        else if (mode == 'b' && !value.empty())
+        {
+            if (setting)
+                channel->addBan(value);
+            else
+                channel->removeBan(value);
+        }
+        else if (mode == 'o' || mode == 'v')
+        {
+            Client *target = findClientByNickname(value);
+            if (target)
+                channel->setMemberMode(target, mode == 'o' ? MEMBER_OP : MEMBER_VOICE, setting);
+        }
+    }
+}
+
+Client *Server::linkSource(Client *link, const std::string &source)
+{
+    Client *client = findClientByNickname(source);
+    if (!client || client->getUplink() != link)
+        return NULL;
+    return client;
+}
+
+bool Server::isLinkServer(Client *link, const std::string &source)
+{
+    std::map<std::string, Client *>::iterator it = _servers.find(source);
+    return it != _servers.end() && it->second == link;
+}
+
+void Server::processLinkCommand(Client *link, const std::string &line)
+{
+    if (line[0] != ':')
+    {
+        std::vector<std::string> args = splitCommand(line);
+        if (!args.empty() && args[0] == "ERROR")
+        {
+            std::cout << "[" << link->getFd() << "] Link error: " << line << std::endl;
+            removeClient(link, "");
+        }
+        return;
+    }
+
+    size_t space = line.find(' ');
+    if (space == std::string::npos)
+        return;
+    std::string prefix = line.substr(1, space - 1);
+    std::string source = prefix.substr(0, prefix.find('!'));
+    std::vector<std::string> args = splitCommand(line, space + 1);
+    if (args.empty())
+        return;
+
+    const std::string &cmd = args[0];
+    std::string raw = line + "\r\n";
+    bool fromServer = isLinkServer(link, source);
+    Client *user = fromServer ? NULL : linkSource(link, source);
+    if (!fromServer && !user)
+        return;
+
+    if (cmd == "SERVER" && fromServer && args.size() > 1)
+    {
+        if (args[1] == _serverName || _servers.count(args[1]))
+        {
+            link->sendMessage("ERROR :Server " + args[1] + " already exists\r\n");
+            link->flush();
+            removeClient(link, "");
+            return;
+        }
+        _servers[args[1]] = link;
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "UID" && fromServer && args.size() > 4)
+    {
+        long ts = std::atol(args[2].c_str());
+        if (!resolveCollision(link, args[1], ts, NULL))
+            return;
+
+        Client *remote = new Client(-1);
+        remote->setNickname(args[1]);
+        remote->setNickTs(ts);
+        remote->setUsername(args[3]);
+        remote->setRealname(stripColon(args[4]));
+        remote->setAuthenticated(true);
+        remote->setRegistered(true);
+        remote->setUplink(link);
+        remote->setOrigin(source);
+        _clients_by_nick[foldNick(args[1])] = remote;
+        _users.insert(remote, foldNick(args[1]), userFlags(remote));
+        notifyMonitors(args[1], remote);
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "SJOIN" && fromServer && args.size() > 3)
+    {
+        Channel *channel = findChannel(args[1]);
+        bool created = !channel;
+        if (created)
+        {
+            if (args[1][0] != '#')
+                return;
+            channel = createChannel(args[1]);
+            std::vector<std::string> modeArgs(args.begin(), args.end() - 1);
+            applyLinkModes(channel, modeArgs, 2);
+        }
+
+        std::istringstream members(stripColon(args.back()));
+        std::string entry;
+        while (members >> entry)
+        {
+            size_t prefix = entry.find_first_not_of("@+");
+            if (prefix == std::string::npos)
+                continue;
+            Client *member = linkSource(link, entry.substr(prefix));
+            if (!member || channel->hasClient(member))
+                continue;
+
+            channel->addClient(member);
+            channel->broadcast(":" + member->getNickname() + "!user@localhost JOIN " + args[1] + "\r\n", member);
+            sendAwayJoin(channel, member);
+            std::string modes = "+";
+            std::string params;
+            for (size_t i = 0; i < prefix; ++i)
+            {
+                modes += (entry[i] == '@') ? 'o' : 'v';
+                params += " " + member->getNickname();
+                channel->setMemberMode(member, entry[i] == '@' ? MEMBER_OP : MEMBER_VOICE, true);
+            }
+            if (prefix)
+                channel->broadcast(":" + source + " MODE " + args[1] + " " + modes + params + "\r\n", member);
+            if (channel->isInvited(member->getNickname()))
+                channel->removeInvitation(member->getNickname());
+        }
+
+        if (channel->getClientCount() == 0)
+        {
+            _channels.erase(args[1]);
+            delete channel;
+            return;
+        }
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "KILL" && args.size() > 2)
+    {
+        Client *target = findClientByNickname(args[1]);
+        if (target && target->getNickTs() == std::atol(args[2].c_str()))
+        {
+            std::string reason = (args.size() > 3) ? stripColon(args[3]) : "Killed";
+            std::string quitMsg = ":" + target->getNickname() + "!user@localhost QUIT :Killed (" + reason + ")\r\n";
+            const std::vector<Channel *> &joined = target->getChannels();
+            for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
+                (*it)->broadcast(quitMsg, target);
+            if (!target->getUplink())
+            {
+                target->sendMessage("ERROR :Closing Link: " + target->getNickname() + " (Killed (" + reason + "))\r\n");
+                target->flush();
+            }
+            removeClient(target, "");
+        }
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "EOB" && fromServer)
+    {
+        std::cout << "Link: end of burst from " << source << std::endl;
+    }
+    else if (cmd == "NICK" && user && args.size() > 2)
+    {
+        std::string oldNick = user->getNickname();
+        long ts = std::atol(args[2].c_str());
+        if (!resolveCollision(link, args[1], ts, user))
+        {
+            killClient(user, "Nick collision");
+            return;
+        }
+
+        std::string nickMsg = ":" + oldNick + "!user@localhost NICK :" + args[1] + "\r\n";
+        std::set<Client *> recipients;
+        const std::vector<Channel *> &joined = user->getChannels();
+        for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
+        {
+            const std::vector<Client *> &clients = (*it)->getClients();
+            recipients.insert(clients.begin(), clients.end());
+        }
+        for (std::set<Client *>::iterator it = recipients.begin(); it != recipients.end(); ++it)
+            (*it)->sendMessage(nickMsg);
+
+        recordWhowas(user);
+        _clients_by_nick.erase(foldNick(oldNick));
+        user->setNickname(args[1]);
+        user->setNickTs(ts);
+        _clients_by_nick[foldNick(args[1])] = user;
+        _users.rename(user, foldNick(args[1]));
+        notifyMonitors(oldNick, NULL);
+        notifyMonitors(args[1], user);
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "AWAY" && user)
+    {
+        setAway(user, args.size() > 1 ? stripColon(args[1]) : "");
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "QUIT" && user)
+    {
+        std::string reason = (args.size() > 1) ? stripColon(args[1]) : "Quit";
+        const std::vector<Channel *> &joined = user->getChannels();
+        for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
+            (*it)->broadcast(raw, user);
+        removeClient(user, reason);
+    }
+    else if ((cmd == "PRIVMSG" || cmd == "NOTICE") && user && args.size() > 2)
+    {
+        long long time;
+        std::string msgid;
+        std::string tags = messageTags(time, msgid);
+
+        if (args[1][0] == '#')
+        {
+            Channel *channel = findChannel(args[1]);
+            if (!channel)
+                return;
+            channel->broadcast(raw, user, tags);
+            channel->addHistory(time, msgid, "@" + tags + " " + raw);
+            sendToChannelLinks(channel, raw, link);
+        }
+        else
+        {
+            Client *target = findClientByNickname(args[1]);
+            if (target && !target->getUplink())
+            {
+                if (acceptsPrivate(target, user, false))
+                    target->sendTagged(tags, raw);
+            }
+            else if (target && target->getUplink() != link)
+                target->getUplink()->sendMessage(raw);
+        }
+    }
+    else if ((cmd == "PART" || cmd == "KICK") && args.size() > 1 && (user || cmd == "KICK"))
+    {
+        Channel *channel = findChannel(args[1]);
+        Client *target = (cmd == "KICK" && args.size() > 2) ? findClientByNickname(args[2]) : user;
+        if (channel && target && channel->hasClient(target))
+        {
+            channel->broadcast(raw);
+            dropMember(channel, target);
+        }
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "TOPIC" && args.size() > 2)
+    {
+        Channel *channel = findChannel(args[1]);
+        if (!channel)
+            return;
+
+        long long time;
+        std::string msgid;
+        std::string tags = messageTags(time, msgid);
+        channel->setTopic(stripColon(args[2]));
+        channel->broadcast(raw, NULL, tags);
+        channel->addHistory(time, msgid, "@" + tags + " " + raw);
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "MODE" && args.size() > 2)
+    {
+        Channel *channel = findChannel(args[1]);
+        if (!channel)
+            return;
+        applyLinkModes(channel, args, 2);
+        channel->broadcast(raw);
+        sendToLinks(raw, link);
+    }
+    else if (cmd == "INVITE" && user && args.size() > 2)
+    {
+        Channel *channel = findChannel(args[2]);
+        if (channel)
+            channel->addInvitation(args[1]);
+
+        Client *target = findClientByNickname(args[1]);
+        if (target && !target->getUplink())
+            target->sendMessage(raw);
+        else if (target && target->getUplink() != link)
+            target->getUplink()->sendMessage(raw);
+    }
+}
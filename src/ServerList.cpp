@@ -0,0 +1,123 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include <cstdlib>
+#include <sstream>
+
+void Server::handleList(Client *client, const std::vector<std::string> &args)
+{
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+
+    ListQuery query;
+    query.active = true;
+
+    if (args.size() > 1)
+    {
+        std::stringstream ss(args[1][0] == ':' ? args[1].substr(1) : args[1]);
+        std::string token;
+        long now = currentTimeMs() / 1000;
+        while (std::getline(ss, token, ','))
+        {
+            if (token.empty())
+                continue;
+            if (token[0] == '>' || token[0] == '<')
+            {
+                long count = std::atol(token.c_str() + 1);
+                if (token[0] == '>')
+                    query.minUsers = count + 1;
+                else if (count <= 0)
+                    query.active = false;
+                else if (static_cast<size_t>(count - 1) < query.maxUsers)
+                    query.maxUsers = count - 1;
+            }
+            else if ((token[0] == 'T' || token[0] == 't') && token.size() > 2 && (token[1] == '<' || token[1] == '>'))
+            {
+                long seconds = std::atol(token.c_str() + 2) * 60;
+                if (token[1] == '<')
+                    query.topicAfter = now - seconds;
+                else
+                    query.topicBefore = now - seconds;
+            }
+            else if (token[0] == '!')
+            {
+                query.excludes.push_back(token.substr(1));
+            }
+            else
+            {
+                query.masks.push_back(token);
+            }
+        }
+    }
+
+    client->sendMessage(":localhost 321 " + client->getNickname() + " Channel :Users  Name\r\n");
+    client->_list = query;
+    if (!query.active)
+        client->sendMessage(":localhost 323 " + client->getNickname() + " :End of /LIST\r\n");
+}
+
+bool Server::listMatches(const ListQuery &query, Channel *channel)
+{
+    size_t users = channel->getClientCount();
+    if (users < query.minUsers || users > query.maxUsers)
+        return false;
+    if (query.topicAfter && channel->getTopicTime() < query.topicAfter)
+        return false;
+    if (query.topicBefore && (!channel->getTopicTime() || channel->getTopicTime() > query.topicBefore))
+        return false;
+
+    for (std::vector<std::string>::const_iterator it = query.excludes.begin(); it != query.excludes.end(); ++it)
+    {
+        if (matchMask(*it, channel->getName()))
+            return false;
+    }
+    if (query.masks.empty())
+        return true;
+    for (std::vector<std::string>::const_iterator it = query.masks.begin(); it != query.masks.end(); ++it)
+    {
+        if (matchMask(*it, channel->getName()))
+            return true;
+    }
+    return false;
+}
+
+bool Server::continueLists()
+{
+    bool ready = false;
+    for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+    {
+        Client *client = it->second;
+        ListQuery &query = client->_list;
+        if (!query.active || client->getPendingOutput() >= LIST_QUEUE_LOW)
+            continue;
+
+        std::ostringstream reply;
+        std::map<std::string, Channel *>::iterator channel = query.cursor.empty()
+            ? _channels.begin() : _channels.upper_bound(query.cursor);
+        size_t emitted = 0;
+        for (size_t scanned = 0; channel != _channels.end() && emitted < LIST_BATCH && scanned < LIST_SCAN; ++channel, ++scanned)
+        {
+            query.cursor = channel->first;
+            if (!listMatches(query, channel->second))
+                continue;
+            if (channel->second->hasMode(CHANNEL_SECRET | CHANNEL_PRIVATE) && !channel->second->hasClient(client))
+                continue;
+            reply << ":localhost 322 " << client->getNickname() << " " << channel->first << " "
+                  << channel->second->getClientCount() << " :" << channel->second->getTopic() << "\r\n";
+            ++emitted;
+        }
+        if (channel == _channels.end())
+        {
+            reply << ":localhost 323 " << client->getNickname() << " :End of /LIST\r\n";
+            query = ListQuery();
+        }
+        client->sendMessage(reply.str());
+
+        if (query.active && !client->isBlocked())
+            ready = true;
+    }
+    return ready;
+}
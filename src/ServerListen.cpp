@@ -0,0 +1,228 @@
+#include "Server.hpp"
+#include "Tls.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <sys/stat.h>
+
+Listener::Listener() : fd(-1), trusted(false), tls(false), websocket(false), maxClients(0), sendq(0), clients(0)
+{
+}
+
+void Server::addListener(const std::string &spec)
+{
+    _listenSpecs.push_back(spec);
+}
+
+bool Server::parseListener(const std::string &spec, Listener &listener)
+{
+    std::stringstream ss(spec);
+    std::string option;
+    std::getline(ss, listener.address, ';');
+    if (listener.address.empty())
+        return false;
+
+    while (std::getline(ss, option, ';'))
+    {
+        if (option == "trusted")
+            listener.trusted = true;
+        else if (option == "tls")
+            listener.tls = true;
+        else if (option == "ws")
+            listener.websocket = true;
+        else if (option.compare(0, 4, "max=") == 0)
+            listener.maxClients = std::strtoul(option.c_str() + 4, NULL, 10);
+        else if (option.compare(0, 6, "sendq=") == 0)
+            listener.sendq = std::strtoul(option.c_str() + 6, NULL, 10);
+        else
+            return false;
+    }
+    return true;
+}
+
+static int bindInet(const std::string &host, const std::string &port, bool dualStack)
+{
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+
+    addrinfo *result;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+        return -1;
+
+    int fd = socket(result->ai_family, SOCK_STREAM, 0);
+    if (fd >= 0)
+    {
+        int opt = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        if (result->ai_family == AF_INET6)
+        {
+            int v6only = dualStack ? 0 : 1;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+        }
+        if (bind(fd, result->ai_addr, result->ai_addrlen) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+bool Server::clearStaleSocket(const std::string &path)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) < 0)
+        return errno == ENOENT;
+    if (!S_ISSOCK(st.st_mode))
+    {
+        std::cerr << path << " exists and is not a socket, refusing to replace it" << std::endl;
+        return false;
+    }
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return false;
+    std::strcpy(addr.sun_path, path.c_str());
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+        return false;
+    bool stale = connect(probe, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno == ECONNREFUSED;
+    close(probe);
+    if (!stale)
+    {
+        std::cerr << path << " is in use by another process" << std::endl;
+        return false;
+    }
+    return unlink(path.c_str()) == 0;
+}
+
+static int bindUnix(const std::string &path)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        return -1;
+    std::strcpy(addr.sun_path, path.c_str());
+
+    if (!Server::clearStaleSocket(path))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool Server::setTls(const std::string &certificate, const std::string &key)
+{
+    return TlsSession::initialize(certificate, key);
+}
+
+bool Server::openListener(Listener &listener)
+{
+    const std::string &address = listener.address;
+    size_t colon = address.rfind(':');
+
+    if (listener.tls && !TlsSession::isAvailable())
+    {
+        std::cerr << "TLS listener " << address << " needs IRCSERV_TLS_CERT and IRCSERV_TLS_KEY" << std::endl;
+        return false;
+    }
+
+    if (address.compare(0, 5, "unix:") == 0)
+        listener.fd = bindUnix(address.substr(5));
+    else if (colon == std::string::npos)
+    {
+        listener.fd = bindInet("::", address, true);
+        if (listener.fd < 0)
+            listener.fd = bindInet("0.0.0.0", address, false);
+    }
+    else if (address[0] == '[' && colon > 1 && address[colon - 1] == ']')
+    {
+        std::string host = address.substr(1, colon - 2);
+        listener.fd = bindInet(host, address.substr(colon + 1), host == "::");
+    }
+    else
+        listener.fd = bindInet(address.substr(0, colon), address.substr(colon + 1), false);
+
+    if (listener.fd < 0 || listen(listener.fd, _config->backlog) < 0)
+    {
+        std::cerr << "Bind error on " << address << std::endl;
+        if (listener.fd >= 0)
+            close(listener.fd);
+        listener.fd = -1;
+        return false;
+    }
+
+    fcntl(listener.fd, F_SETFL, O_NONBLOCK);
+    fcntl(listener.fd, F_SETFD, FD_CLOEXEC);
+    FD_SET(listener.fd, &_master_set);
+    if (listener.fd > _fd_max)
+        _fd_max = listener.fd;
+    std::cout << "Listening on " << address << (listener.tls ? " (tls)" : "") << (listener.websocket ? " (websocket)" : "") << (listener.trusted ? " (trusted)" : "") << std::endl;
+    return true;
+}
+
+bool Server::openListeners()
+{
+    std::ostringstream port;
+    port << _port;
+    std::vector<std::string> specs(1, port.str());
+    specs.insert(specs.end(), _listenSpecs.begin(), _listenSpecs.end());
+
+    for (std::vector<std::string>::iterator it = specs.begin(); it != specs.end(); ++it)
+    {
+        Listener listener;
+        if (!parseListener(*it, listener))
+        {
+            std::cerr << "Invalid listener: " << *it << std::endl;
+            return false;
+        }
+        if (!openListener(listener))
+            return false;
+        _listeners.push_back(listener);
+    }
+    return true;
+}
+
+void Server::closeListeners(bool unlinkSockets)
+{
+    for (std::vector<Listener>::iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+    {
+        if (it->fd < 0)
+            continue;
+        close(it->fd);
+        if (unlinkSockets && it->address.compare(0, 5, "unix:") == 0)
+            unlink(it->address.c_str() + 5);
+    }
+    _listeners.clear();
+}
+
+Listener *Server::findListener(int fd)
+{
+    for (std::vector<Listener>::iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+    {
+        if (it->fd == fd)
+            return &*it;
+    }
+    return NULL;
+}
@@ -0,0 +1,112 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include <sstream>
+
+void Server::handlePrivmsg(Client *client, const std::vector<std::string> &args)
+{
+    deliverMessage(client, args, "PRIVMSG");
+}
+
+void Server::handleNotice(Client *client, const std::vector<std::string> &args)
+{
+    deliverMessage(client, args, "NOTICE");
+}
+
+void Server::deliverMessage(Client *client, const std::vector<std::string> &args, const std::string &command)
+{
+    bool notice = (command == "NOTICE");
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        if (!notice)
+            client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    if (args.size() < 3)
+    {
+        if (!notice)
+            client->sendMessage(":localhost 461 * " + command + " :Not enough parameters\r\n");
+        return;
+    }
+
+    std::string message;
+    for (size_t i = 2; i < args.size(); ++i)
+    {
+        std::string part = args[i];
+        if (i == 2 && !part.empty() && part[0] == ':')
+            part = part.substr(1);
+        if (!message.empty())
+            message += " ";
+        message += part;
+    }
+    if (message.empty())
+    {
+        if (!notice)
+            client->sendMessage(":localhost 412 * :No text to send\r\n");
+        return;
+    }
+
+    std::string prefix = ":" + nickname + "!user@localhost " + command + " ";
+    std::stringstream targets(args[1]);
+    std::string target;
+    size_t count = 0;
+    while (std::getline(targets, target, ','))
+    {
+        if (target.empty())
+            continue;
+        if (++count > MESSAGE_TARGETS)
+        {
+            if (!notice)
+                client->sendMessage(":localhost 407 " + nickname + " " + target + " :Too many recipients\r\n");
+            break;
+        }
+
+        long long time;
+        std::string msgid;
+        std::string line = prefix + target + " :" + message + "\r\n";
+        if (target[0] == '#')
+        {
+            Channel *channel = findChannel(target);
+            if (!channel)
+            {
+                if (!notice)
+                    client->sendMessage(":localhost 403 * " + target + " :No such channel\r\n");
+                continue;
+            }
+            if (!channel->canSend(client))
+            {
+                if (!notice)
+                    client->sendMessage(":localhost 404 * " + target + " :Cannot send to channel\r\n");
+                continue;
+            }
+
+            std::string tags = messageTags(time, msgid);
+            channel->broadcast(line, client->hasCap(CAP_ECHO_MESSAGE) ? NULL : client, tags);
+            channel->addHistory(time, msgid, "@" + tags + " " + line);
+            sendToChannelLinks(channel, line);
+            continue;
+        }
+
+        Client *targetClient = findClientByNickname(target);
+        if (!targetClient)
+        {
+            if (!notice)
+                client->sendMessage(":localhost 401 " + nickname + " " + target + " :No such nick/channel\r\n");
+            continue;
+        }
+        if (!acceptsPrivate(targetClient, client, !notice))
+            continue;
+
+        if (!notice && targetClient->isAway())
+            sendAwayReply(client, targetClient);
+
+        std::string tags = messageTags(time, msgid);
+        if (targetClient->getUplink())
+            targetClient->getUplink()->sendMessage(line);
+        else
+            targetClient->sendTagged(tags, line);
+        if (client->hasCap(CAP_ECHO_MESSAGE))
+            client->sendTagged(tags, line);
+    }
+}
@@ -0,0 +1,351 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <climits>
+
+struct ModeChange
+{
+    bool setting;
+    char mode;
+    std::string param;
+};
+
+static std::vector<std::string> modeLines(const std::vector<ModeChange> &changes)
+{
+    std::vector<std::string> lines;
+    std::string modes;
+    std::string params;
+    size_t counted = 0;
+    char sign = 0;
+
+    for (std::vector<ModeChange>::const_iterator it = changes.begin(); it != changes.end(); ++it)
+    {
+        std::string param = it->param.empty() ? "" : " " + it->param;
+        if (!modes.empty() && ((!param.empty() && counted == MODE_LINE_LIMIT)
+            || modes.size() + params.size() + param.size() + 2 > MODE_LINE_LENGTH))
+        {
+            lines.push_back(modes + params);
+            modes.clear();
+            params.clear();
+            counted = 0;
+            sign = 0;
+        }
+        char wanted = it->setting ? '+' : '-';
+        if (sign != wanted)
+        {
+            modes += wanted;
+            sign = wanted;
+        }
+        modes += it->mode;
+        params += param;
+        if (!param.empty())
+            ++counted;
+    }
+    if (!modes.empty())
+        lines.push_back(modes + params);
+    return lines;
+}
+
+static void sendBanList(Client *client, Channel *channel)
+{
+    std::string nickname = client->getNickname();
+    std::string reply;
+    std::vector<std::string> banList = channel->getBanList();
+    for (std::vector<std::string>::iterator it = banList.begin(); it != banList.end(); ++it)
+        reply += ":localhost 367 " + nickname + " " + channel->getName() + " " + *it + " localhost 0\r\n";
+    reply += ":localhost 368 " + nickname + " " + channel->getName() + " :End of channel ban list\r\n";
+    client->sendMessage(reply);
+}
+
+static unsigned char channelFlag(char mode)
+{
+    switch (mode)
+    {
+    case 'i': return CHANNEL_INVITE_ONLY;
+    case 't': return CHANNEL_TOPIC_LOCK;
+    case 'm': return CHANNEL_MODERATED;
+    case 'n': return CHANNEL_NO_EXTERNAL;
+    case 's': return CHANNEL_SECRET;
+    case 'p': return CHANNEL_PRIVATE;
+    }
+    return 0;
+}
+
+void Server::handleMode(Client *client, const std::vector<std::string> &args)
+{
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 461 * MODE :Not enough parameters\r\n");
+        return;
+    }
+
+    std::string target = args[1];
+    if (!target.empty() && target[0] != '#')
+    {
+        handleUserMode(client, args);
+        return;
+    }
+    if (target.empty())
+    {
+        client->sendMessage(":localhost 461 * MODE :Channel name required (use: MODE #channel +/-modes)\r\n");
+        return;
+    }
+
+    Channel *channel = findChannel(target);
+    if (!channel)
+    {
+        client->sendMessage(":localhost 403 * " + target + " :No such channel\r\n");
+        return;
+    }
+
+    if (args.size() == 2)
+    {
+        client->sendMessage(":localhost 324 " + client->getNickname() + " " + target + " "
+                            + channel->getModeString(channel->hasClient(client)) + "\r\n");
+        return;
+    }
+
+    const std::string &modes = args[2];
+    if (args.size() == 3 && (modes == "b" || modes == "+b"))
+    {
+        sendBanList(client, channel);
+        return;
+    }
+
+    if (!channel->isOperator(client))
+    {
+        client->sendMessage(":localhost 482 * " + target + " :You're not channel operator\r\n");
+        return;
+    }
+
+    std::string nickname = client->getNickname();
+    std::vector<ModeChange> changes;
+    std::vector<Client *> banned;
+    bool listed = false;
+    bool setting = true;
+    size_t next = 3;
+
+    for (size_t i = 0; i < modes.size(); ++i)
+    {
+        char mode = modes[i];
+        if (mode == '+' || mode == '-')
+        {
+            setting = (mode == '+');
+            continue;
+        }
+        unsigned char flag = channelFlag(mode);
+        if (!flag && mode != 'k' && mode != 'l' && mode != 'o' && mode != 'v' && mode != 'b')
+        {
+            client->sendMessage(":localhost 472 " + nickname + " " + std::string(1, mode) + " :is unknown mode char to me\r\n");
+            continue;
+        }
+
+        ModeChange change;
+        change.setting = setting;
+        change.mode = mode;
+        if (mode == 'k' || mode == 'o' || mode == 'v' || mode == 'b' || (mode == 'l' && setting))
+        {
+            if (next >= args.size())
+            {
+                if (mode != 'b')
+                    client->sendMessage(":localhost 461 * MODE :Not enough parameters\r\n");
+                else if (!listed)
+                {
+                    sendBanList(client, channel);
+                    listed = true;
+                }
+                continue;
+            }
+            change.param = args[next++];
+            if (next == args.size() && !change.param.empty() && change.param[0] == ':')
+                change.param.erase(0, 1);
+        }
+
+        if (flag)
+        {
+            if (channel->hasMode(flag) == setting)
+                continue;
+            channel->setMode(flag, setting);
+        }
+        else if (mode == 'k' && setting)
+        {
+            if (change.param.empty())
+            {
+                client->sendMessage(":localhost 461 * MODE :Not enough parameters\r\n");
+                continue;
+            }
+            if (change.param == channel->getKey())
+                continue;
+            channel->setKey(change.param);
+        }
+        else if (mode == 'k')
+        {
+            if (change.param != channel->getKey())
+            {
+                client->sendMessage(":localhost 525 * " + target + " :Key mismatch for -k\r\n");
+                continue;
+            }
+            channel->setKey("");
+        }
+        else if (mode == 'l' && setting)
+        {
+            char *endptr = NULL;
+            long limit = std::strtol(change.param.c_str(), &endptr, 10);
+            if (change.param.empty() || *endptr != '\0' || limit <= 0 || limit > INT_MAX)
+            {
+                client->sendMessage(":localhost 461 * MODE :Invalid +l parameter (limit must be a positive integer > 0)\r\n");
+                continue;
+            }
+            if (limit == channel->getUserLimit())
+                continue;
+            channel->setUserLimit(static_cast<int>(limit));
+            std::ostringstream oss;
+            oss << limit;
+            change.param = oss.str();
+        }
+        else if (mode == 'l')
+        {
+            if (channel->getUserLimit() == 0)
+                continue;
+            channel->setUserLimit(0);
+        }
+        else if (mode == 'o' || mode == 'v')
+        {
+            Client *member = findClientByNickname(change.param);
+            if (!member)
+            {
+                client->sendMessage(":localhost 401 " + nickname + " " + change.param + " :No such nick/channel\r\n");
+                continue;
+            }
+            if (!channel->hasClient(member))
+            {
+                client->sendMessage(":localhost 441 " + nickname + " " + change.param + " " + target + " :They aren't on that channel\r\n");
+                continue;
+            }
+            unsigned char memberMode = (mode == 'o') ? MEMBER_OP : MEMBER_VOICE;
+            if (((channel->getMemberModes(member) & memberMode) != 0) == setting)
+                continue;
+            channel->setMemberMode(member, memberMode, setting);
+            change.param = member->getNickname();
+        }
+        else if (setting)
+        {
+            const std::string &banMask = change.param;
+            if (banMask == nickname || banMask == nickname + "!*@*")
+            {
+                client->sendMessage(":localhost 485 * " + target + " :You cannot ban yourself\r\n");
+                continue;
+            }
+            if (banMask == "*!*@localhost" || banMask == "*!*@*" || banMask == "*")
+            {
+                client->sendMessage(":localhost 486 * " + target + " :Ban mask too broad - would ban everyone\r\n");
+                continue;
+            }
+            if (channel->isBanned(banMask))
+                continue;
+            channel->addBan(banMask);
+
+            Client *bannedClient = NULL;
+            if (banMask.find("!") == std::string::npos && banMask.find("*") == std::string::npos)
+                bannedClient = findClientByNickname(banMask);
+            else if (banMask.length() > 4 && banMask.substr(banMask.length() - 4) == "!*@*")
+                bannedClient = findClientByNickname(banMask.substr(0, banMask.length() - 4));
+            if (bannedClient && channel->hasClient(bannedClient))
+                banned.push_back(bannedClient);
+        }
+        else
+        {
+            if (!channel->isBanned(change.param))
+                continue;
+            channel->removeBan(change.param);
+        }
+        changes.push_back(change);
+    }
+
+    if (changes.empty())
+        return;
+
+    std::vector<std::string> lines = modeLines(changes);
+    std::string prefix = ":" + nickname + "!user@localhost MODE " + target + " ";
+    std::cout << "[" << client->getFd() << "] MODE " << target;
+    for (std::vector<std::string>::iterator it = lines.begin(); it != lines.end(); ++it)
+    {
+        std::string modeMsg = prefix + *it + "\r\n";
+        channel->broadcast(modeMsg);
+        sendToLinks(modeMsg);
+        std::cout << " " << *it;
+    }
+    std::cout << " set by " << nickname << std::endl;
+
+    for (std::vector<Client *>::iterator it = banned.begin(); it != banned.end(); ++it)
+    {
+        Client *bannedClient = *it;
+        if (!channel->hasClient(bannedClient))
+            continue;
+        std::string kickMsg = ":" + nickname + "!user@localhost KICK " + target + " " + bannedClient->getNickname() + " :Banned\r\n";
+        channel->broadcast(kickMsg);
+        sendToLinks(kickMsg);
+
+        bool wasOperator = channel->isOperator(bannedClient);
+        channel->removeClient(bannedClient);
+        if (wasOperator && channel->getClientCount() > 0)
+            channel->promoteNextOperator();
+    }
+}
+
+void Server::handleUserMode(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    if (foldNick(args[1]) != foldNick(nickname))
+    {
+        if (findClientByNickname(args[1]))
+            client->sendMessage(":localhost 502 " + nickname + " :Can't change mode for other users\r\n");
+        else
+            client->sendMessage(":localhost 401 " + nickname + " " + args[1] + " :No such nick/channel\r\n");
+        return;
+    }
+
+    if (args.size() == 2)
+    {
+        client->sendMessage(":localhost 221 " + nickname + " +" + (client->isOper() ? "o" : "")
+                            + (client->_callerid ? "g" : "") + "\r\n");
+        return;
+    }
+
+    std::string modes = args[2][0] == ':' ? args[2].substr(1) : args[2];
+    std::string changed;
+    bool setting = true;
+    char sign = 0;
+    for (size_t i = 0; i < modes.size(); ++i)
+    {
+        if (modes[i] == '+' || modes[i] == '-')
+        {
+            setting = (modes[i] == '+');
+            continue;
+        }
+        if (modes[i] != 'g')
+        {
+            client->sendMessage(":localhost 501 " + nickname + " :Unknown MODE flag\r\n");
+            continue;
+        }
+        if (client->_callerid == setting)
+            continue;
+        client->_callerid = setting;
+        if (sign != (setting ? '+' : '-'))
+        {
+            sign = setting ? '+' : '-';
+            changed += sign;
+        }
+        changed += modes[i];
+    }
+    if (!changed.empty())
+        client->sendMessage(":" + nickname + "!user@localhost MODE " + nickname + " :" + changed + "\r\n");
+}
@@ -0,0 +1,160 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include <sstream>
+
+static void putNickList(std::ostringstream &reply, const char *numeric, const std::string &nickname,
+                        const std::vector<std::string> &items)
+{
+    std::string line;
+    for (std::vector<std::string>::const_iterator it = items.begin(); it != items.end(); ++it)
+    {
+        if (!line.empty() && line.size() + it->size() > 400)
+        {
+            reply << ":localhost " << numeric << " " << nickname << " :" << line << "\r\n";
+            line.clear();
+        }
+        line += (line.empty() ? "" : ",") + *it;
+    }
+    if (!line.empty())
+        reply << ":localhost " << numeric << " " << nickname << " :" << line << "\r\n";
+}
+
+static std::string monitorMask(Client *user)
+{
+    return user->getNickname() + "!" + (user->getUsername().empty() ? "user" : user->getUsername()) + "@localhost";
+}
+
+void Server::notifyMonitors(const std::string &nickname, Client *online)
+{
+    std::map<std::string, std::set<Client *> >::iterator it = _watchers.find(foldNick(nickname));
+    if (it == _watchers.end())
+        return;
+
+    std::string suffix = " :" + (online ? monitorMask(online) : nickname) + "\r\n";
+    std::string numeric = online ? " 730 " : " 731 ";
+    for (std::set<Client *>::iterator watcher = it->second.begin(); watcher != it->second.end(); ++watcher)
+        (*watcher)->sendMessage(":localhost" + numeric + (*watcher)->getNickname() + suffix);
+}
+
+void Server::clearMonitors(Client *client)
+{
+    for (std::map<std::string, std::string>::iterator it = client->_monitoring.begin(); it != client->_monitoring.end(); ++it)
+    {
+        std::map<std::string, std::set<Client *> >::iterator watch = _watchers.find(it->first);
+        if (watch == _watchers.end())
+            continue;
+        watch->second.erase(client);
+        if (watch->second.empty())
+            _watchers.erase(watch);
+        --_monitorTotal;
+    }
+    client->_monitoring.clear();
+}
+
+void Server::handleMonitor(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 461 " + nickname + " MONITOR :Not enough parameters\r\n");
+        return;
+    }
+
+    std::string sub = args[1];
+    std::ostringstream reply;
+    std::map<std::string, std::string> &monitoring = client->_monitoring;
+
+    if ((sub == "+" || sub == "-") && args.size() > 2)
+    {
+        std::stringstream targets(args[2][0] == ':' ? args[2].substr(1) : args[2]);
+        std::string target;
+        std::vector<std::string> online;
+        std::vector<std::string> offline;
+        std::vector<std::string> rejected;
+        while (std::getline(targets, target, ','))
+        {
+            if (target.empty())
+                continue;
+            std::string folded = foldNick(target);
+
+            if (sub == "-")
+            {
+                if (!monitoring.erase(folded))
+                    continue;
+                std::map<std::string, std::set<Client *> >::iterator watch = _watchers.find(folded);
+                if (watch != _watchers.end())
+                {
+                    watch->second.erase(client);
+                    if (watch->second.empty())
+                        _watchers.erase(watch);
+                }
+                --_monitorTotal;
+                continue;
+            }
+
+            if (monitoring.count(folded))
+                continue;
+            if (monitoring.size() >= _config->monitorLimit || _monitorTotal >= _config->monitorTotal)
+            {
+                rejected.push_back(target);
+                continue;
+            }
+            monitoring[folded] = target;
+            _watchers[folded].insert(client);
+            ++_monitorTotal;
+
+            Client *user = findClientByNickname(folded);
+            if (user && user->isRegistered())
+                online.push_back(monitorMask(user));
+            else
+                offline.push_back(target);
+        }
+
+        putNickList(reply, "730", nickname, online);
+        putNickList(reply, "731", nickname, offline);
+        if (!rejected.empty())
+        {
+            std::string list;
+            for (std::vector<std::string>::iterator it = rejected.begin(); it != rejected.end(); ++it)
+                list += (list.empty() ? "" : ",") + *it;
+            reply << ":localhost 734 " << nickname << " " << _config->monitorLimit << " " << list << " :Monitor list is full\r\n";
+        }
+    }
+    else if (sub == "C" || sub == "c")
+    {
+        clearMonitors(client);
+    }
+    else if (sub == "L" || sub == "l")
+    {
+        std::vector<std::string> targets;
+        for (std::map<std::string, std::string>::iterator it = monitoring.begin(); it != monitoring.end(); ++it)
+            targets.push_back(it->second);
+        putNickList(reply, "732", nickname, targets);
+        reply << ":localhost 733 " << nickname << " :End of MONITOR list\r\n";
+    }
+    else if (sub == "S" || sub == "s")
+    {
+        std::vector<std::string> online;
+        std::vector<std::string> offline;
+        for (std::map<std::string, std::string>::iterator it = monitoring.begin(); it != monitoring.end(); ++it)
+        {
+            Client *user = findClientByNickname(it->first);
+            if (user && user->isRegistered())
+                online.push_back(monitorMask(user));
+            else
+                offline.push_back(it->second);
+        }
+        putNickList(reply, "730", nickname, online);
+        putNickList(reply, "731", nickname, offline);
+    }
+    else
+    {
+        reply << ":localhost 461 " << nickname << " MONITOR :Not enough parameters\r\n";
+    }
+    client->sendMessage(reply.str());
+}
@@ -1,116 +1,247 @@
 #include "Server.hpp"
 #include "Client.hpp"
 #include "Channel.hpp"
+#include "Metrics.hpp"
+#include "Platform.hpp"
+#include "Tls.hpp"
+#include "WebSocket.hpp"
 #include <iostream>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
 
-void Server::handleNewConnection(int listen_fd)
+void Server::handleNewConnection(Listener *listener)
 {
-    sockaddr_in client_addr;
+    sockaddr_storage client_addr;
     socklen_t client_len = sizeof(client_addr);
-    int client_fd = accept(listen_fd, (struct sockaddr *)&client_addr, &client_len);
+    int client_fd = accept(listener->fd, (struct sockaddr *)&client_addr, &client_len);
     if (client_fd >= 0)
     {
+        if ((listener->maxClients && listener->clients >= listener->maxClients) || client_fd >= FD_SETSIZE)
+        {
+            send(client_fd, "ERROR :Too many connections\r\n", 30, MSG_NOSIGNAL);
+            close(client_fd);
+            return;
+        }
         fcntl(client_fd, F_SETFL, O_NONBLOCK);
+        fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+        if (client_addr.ss_family != AF_UNIX)
+        {
+            int nodelay = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        }
 
-        Client *client = new Client(client_fd);
-        _clients[client_fd] = client;
+        attachClient(client_fd, listener);
+    }
+}
 
-        FD_SET(client_fd, &_master_set);
-        if (client_fd > _fd_max)
+Client *Server::attachClient(int fd, Listener *listener)
+{
+    Client *client = new Client(fd);
+    if (listener && listener->tls)
+    {
+        client->_tls = new TlsSession(fd);
+        if (!client->_tls->isValid())
         {
-            _fd_max = client_fd;
+            delete client;
+            return NULL;
         }
+    }
+    if (listener && listener->websocket)
+        client->_ws = new WebSocket();
+    if (listener)
+    {
+        client->_listener = listener->fd;
+        client->_sendq = listener->sendq;
+        ++listener->clients;
+    }
+    _clients[fd] = client;
+    g_metrics.connectionOpened();
+    _trace.record(TRACE_OPEN, fd, currentTimeMs());
 
-        std::cout << "New connection: " << client_fd << " (fd_max: " << _fd_max << ")" << std::endl;
+    if (fd < FD_SETSIZE)
+    {
+        FD_SET(fd, &_master_set);
+        if (fd > _fd_max)
+            _fd_max = fd;
+    }
+
+    std::cout << "New connection: " << fd << " (fd_max: " << _fd_max << ")" << std::endl;
 
+    if (listener && listener->trusted)
+        client->setAuthenticated(true);
+    else if (!client->_ws)
         client->sendMessage(":localhost NOTICE * :Please authenticate with PASS <password> before using other commands.\r\n");
-    }
+    return client;
 }
 
 void Server::handleClientData(Client *client)
 {
-    char buf[512];
-    int nbytes = recv(client->getFd(), buf, sizeof(buf) - 1, 0);
-    if (nbytes <= 0)
+    if (_recvBuffer.size() != _config->recvSize)
+        _recvBuffer.resize(_config->recvSize);
+    char *buf = &_recvBuffer[0];
+    size_t size = _recvBuffer.size();
+    int nbytes;
+    bool closed;
+    std::string data;
+    if (client->_tls)
     {
-        std::cout << "Connection closed: " << client->getFd() << std::endl;
-        removeClient(client);
+        while ((nbytes = client->_tls->read(buf, size)) > 0)
+        {
+            data.append(buf, nbytes);
+        }
+        client->flush();
+        closed = (nbytes == 0);
     }
     else
     {
-        buf[nbytes] = '\0';
-        std::string data(buf);
+        nbytes = g_platform->recv(client->getFd(), buf, size);
+        if (nbytes > 0)
+            data.assign(buf, nbytes);
+        closed = (nbytes <= 0);
+    }
 
-        std::cout << "[" << client->getFd() << "] Received data: " << data << std::endl;
+    if (!data.empty())
+    {
+        int fd = client->getFd();
+        receiveData(client, data);
+        if (_clients.find(fd) == _clients.end())
+            return;
+    }
+    if (closed)
+    {
+        std::cout << "Connection closed: " << client->getFd() << std::endl;
+        removeClient(client);
+    }
+}
 
-        std::string &buffer = client->_buffer;
-        buffer += data;
+void Server::receiveData(Client *client, std::string data)
+{
+    g_metrics.addBytesIn(data.size());
 
-        size_t pos;
-        while ((pos = buffer.find("\r\n")) != std::string::npos)
+    if (client->_ws)
+    {
+        bool opened = client->_ws->isOpen();
+        std::string lines;
+        std::string reply;
+        bool keep = client->_ws->receive(data, lines, reply);
+        client->sendRaw(reply);
+        if (!keep)
         {
-            std::string command = buffer.substr(0, pos);
-            buffer.erase(0, pos + 2);
+            client->flush();
+            removeClient(client, "WebSocket closed");
+            return;
+        }
+        if (!opened && client->_ws->isOpen() && !client->isAuthenticated())
+            client->sendMessage(":localhost NOTICE * :Please authenticate with PASS <password> before using other commands.\r\n");
+        data = lines;
+        if (data.empty())
+            return;
+    }
 
-            if (!command.empty())
-            {
-                std::cout << "[" << client->getFd() << "] Processing command: " << command << std::endl;
-                processCommand(client, command);
-            }
+    std::cout << "[" << client->getFd() << "] Received data: " << data << std::endl;
+
+    std::string &buffer = client->_buffer;
+    buffer += data;
+
+    size_t pos;
+    while ((pos = buffer.find("\r\n")) != std::string::npos)
+    {
+        std::string command = buffer.substr(0, pos);
+        buffer.erase(0, pos + 2);
+
+        if (!command.empty())
+        {
+            int fd = client->getFd();
+            std::cout << "[" << fd << "] Processing command: " << command << std::endl;
+            _trace.record(TRACE_LINE, fd, currentTimeMs(), command);
+            processCommand(client, command);
+            if (_clients.find(fd) == _clients.end())
+                return;
         }
     }
 }
 
-void Server::removeClient(Client *client)
+void Server::flushClients()
+{
+    flushJoins();
+    for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+    {
+        if (it->second->hasCorkedOutput())
+            it->second->flush();
+    }
+}
+
+void Server::removeClient(Client *client, const std::string &reason)
 {
     if (!client)
         return;
+    flushJoins();
 
     int fd = client->getFd();
 
-    std::cout << "Removing client: " << fd << std::endl;
+    if (fd >= 0)
+    {
+        std::cout << "Removing client: " << fd << std::endl;
 
-    FD_CLR(fd, &_master_set);
+        if (client->_ws && client->_ws->isOpen())
+            client->sendRaw(WebSocket::closeFrame(1000));
+        client->flush();
 
-    if (fd == _fd_max)
-    {
-        _fd_max = _listen_fd;
-        for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+        if (Listener *listener = findListener(client->_listener))
+            --listener->clients;
+
+        if (fd < FD_SETSIZE)
         {
-            if (it->first != fd && it->first > _fd_max)
+            FD_CLR(fd, &_master_set);
+            while (_fd_max > 0 && !FD_ISSET(_fd_max, &_master_set))
             {
-                _fd_max = it->first;
+                --_fd_max;
             }
         }
+        _clients.erase(fd);
+        _linkPeers.erase(fd);
+        g_metrics.connectionClosed();
+        _trace.record(TRACE_CLOSE, fd, currentTimeMs());
     }
 
-    if (!client->getNickname().empty())
+    if (client->isServer())
+    {
+        splitLink(client);
+    }
+    else if (!reason.empty() && client->isRegistered() && !client->getNickname().empty())
     {
-        _clients_by_nick.erase(client->getNickname());
+        sendToLinks(":" + client->getNickname() + "!user@localhost QUIT :" + reason + "\r\n", client->getUplink());
     }
 
+    if (!client->getNickname().empty() && findClientByNickname(client->getNickname()) == client)
+    {
+        recordWhowas(client);
+        _clients_by_nick.erase(foldNick(client->getNickname()));
+        if (client->isRegistered())
+            notifyMonitors(client->getNickname(), NULL);
+    }
+    clearMonitors(client);
+    _users.remove(client);
+
     std::vector<std::string> channelsToDelete;
-    for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+    std::vector<Channel *> joined = client->getChannels();
+    for (std::vector<Channel *>::iterator it = joined.begin(); it != joined.end(); ++it)
     {
-        Channel *channel = it->second;
-        if (channel->hasClient(client))
-        {
-            bool wasOperator = channel->isOperator(client);
-            channel->removeClient(client);
+        Channel *channel = *it;
+        bool wasOperator = channel->isOperator(client);
+        channel->removeClient(client);
 
-            if (wasOperator && !channel->hasOperators() && !channel->getClients().empty())
-            {
-                channel->promoteNextOperator();
-            }
+        if (wasOperator && !channel->hasOperators() && channel->getClientCount() > 0)
+        {
+            channel->promoteNextOperator();
+        }
 
-            if (channel->getClients().empty())
-            {
-                channelsToDelete.push_back(it->first);
-            }
+        if (channel->getClientCount() == 0)
+        {
+            channelsToDelete.push_back(channel->getName());
         }
     }
 
@@ -121,6 +252,5 @@ void Server::removeClient(Client *client)
         _channels.erase(*it);
     }
 
-    _clients.erase(fd);
     delete client;
 }
@@ -0,0 +1,188 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include <sstream>
+
+static std::string normalizeMask(const std::string &mask)
+{
+    std::string nick = mask;
+    std::string user = "*";
+    std::string host = "*";
+    size_t bang = mask.find('!');
+    size_t at = mask.find('@', bang == std::string::npos ? 0 : bang);
+    if (bang != std::string::npos)
+    {
+        nick = mask.substr(0, bang);
+        user = mask.substr(bang + 1, at == std::string::npos ? std::string::npos : at - bang - 1);
+    }
+    else if (at != std::string::npos)
+    {
+        nick = "*";
+        user = mask.substr(0, at);
+    }
+    if (at != std::string::npos)
+        host = mask.substr(at + 1);
+    return (nick.empty() ? "*" : nick) + "!" + (user.empty() ? "*" : user) + "@" + (host.empty() ? "*" : host);
+}
+
+std::string Server::silenceNick(const std::string &mask)
+{
+    size_t bang = mask.find('!');
+    if (bang == std::string::npos || mask.compare(bang, std::string::npos, "!*@*") != 0
+        || mask.find_first_of("*?") < bang)
+        return "";
+    return mask.substr(0, bang);
+}
+
+bool Server::acceptsPrivate(Client *target, Client *source, bool reply)
+{
+    if (target->getUplink() || (target->_silence.empty() && !target->_callerid))
+        return true;
+
+    std::string folded = foldNick(source->getNickname());
+    std::string username = source->getUsername().empty() ? "user" : source->getUsername();
+    if (!target->_silence.empty())
+    {
+        if (target->_silenceNicks.count(folded))
+            return false;
+        if (target->_silence.size() > target->_silenceNicks.size())
+        {
+            std::string full = folded + "!" + foldNick(username) + "@localhost";
+            for (std::set<std::string>::iterator it = target->_silence.begin(); it != target->_silence.end(); ++it)
+            {
+                if (matchMask(*it, full))
+                    return false;
+            }
+        }
+    }
+
+    if (!target->_callerid || source == target || target->_accepted.count(folded))
+        return true;
+    if (reply)
+    {
+        source->sendMessage(":localhost 716 " + source->getNickname() + " " + target->getNickname()
+                            + " :is in +g mode (server-side ignore)\r\n");
+        long long now = currentTimeMs();
+        if (now - target->_calleridNotified >= CALLERID_NOTIFY_INTERVAL)
+        {
+            target->_calleridNotified = now;
+            target->sendMessage(":localhost 718 " + target->getNickname() + " " + source->getNickname() + " " + username
+                                + "@localhost :is messaging you, and you have umode +g.\r\n");
+            source->sendMessage(":localhost 717 " + source->getNickname() + " " + target->getNickname()
+                                + " :has been informed that you messaged them.\r\n");
+        }
+    }
+    return false;
+}
+
+void Server::handleSilence(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    std::ostringstream reply;
+
+    if (args.size() < 2)
+    {
+        for (std::set<std::string>::iterator it = client->_silence.begin(); it != client->_silence.end(); ++it)
+            reply << ":localhost 271 " << nickname << " " << nickname << " " << *it << "\r\n";
+        reply << ":localhost 272 " << nickname << " :End of Silence List\r\n";
+        client->sendMessage(reply.str());
+        return;
+    }
+
+    std::stringstream entries(args[1][0] == ':' ? args[1].substr(1) : args[1]);
+    std::string entry;
+    while (std::getline(entries, entry, ','))
+    {
+        bool adding = (entry.empty() || entry[0] != '-');
+        if (!entry.empty() && (entry[0] == '+' || entry[0] == '-'))
+            entry.erase(0, 1);
+        if (entry.empty())
+            continue;
+
+        std::string mask = foldNick(normalizeMask(entry));
+        std::string nick = silenceNick(mask);
+        if (adding)
+        {
+            if (client->_silence.count(mask))
+                continue;
+            if (client->_silence.size() >= SILENCE_LIMIT)
+            {
+                reply << ":localhost 511 " << nickname << " " << mask << " :Your silence list is full\r\n";
+                continue;
+            }
+            client->_silence.insert(mask);
+            if (!nick.empty())
+                client->_silenceNicks.insert(nick);
+        }
+        else
+        {
+            if (!client->_silence.erase(mask))
+                continue;
+            if (!nick.empty())
+                client->_silenceNicks.erase(nick);
+        }
+        reply << ":" << nickname << "!user@localhost SILENCE " << (adding ? "+" : "-") << mask << "\r\n";
+    }
+    client->sendMessage(reply.str());
+}
+
+void Server::handleAccept(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 461 " + nickname + " ACCEPT :Not enough parameters\r\n");
+        return;
+    }
+
+    std::ostringstream reply;
+    std::map<std::string, std::string> &accepted = client->_accepted;
+    std::string list = args[1][0] == ':' ? args[1].substr(1) : args[1];
+    if (list == "*")
+    {
+        for (std::map<std::string, std::string>::iterator it = accepted.begin(); it != accepted.end(); ++it)
+            reply << ":localhost 281 " << nickname << " " << it->second << "\r\n";
+        reply << ":localhost 282 " << nickname << " :End of /ACCEPT list\r\n";
+        client->sendMessage(reply.str());
+        return;
+    }
+
+    std::stringstream entries(list);
+    std::string entry;
+    while (std::getline(entries, entry, ','))
+    {
+        bool removing = (!entry.empty() && entry[0] == '-');
+        if (removing)
+            entry.erase(0, 1);
+        if (entry.empty())
+            continue;
+
+        std::string folded = foldNick(entry);
+        if (removing)
+        {
+            if (!accepted.erase(folded))
+                reply << ":localhost 458 " << nickname << " " << entry << " :is not on your accept list\r\n";
+            continue;
+        }
+
+        Client *user = findClientByNickname(entry);
+        if (!user)
+            reply << ":localhost 401 " << nickname << " " << entry << " :No such nick/channel\r\n";
+        else if (accepted.count(folded))
+            reply << ":localhost 457 " << nickname << " " << user->getNickname() << " :is already on your accept list\r\n";
+        else if (accepted.size() >= ACCEPT_LIMIT)
+            reply << ":localhost 456 " << nickname << " :Accept list is full\r\n";
+        else
+            accepted[folded] = user->getNickname();
+    }
+    client->sendMessage(reply.str());
+}
@@ -0,0 +1,199 @@
+#include "Server.hpp"
+#include "Channel.hpp"
+#include "Snapshot.hpp"
+#include <iostream>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+void Server::setSnapshot(const std::string &path, int interval)
+{
+    _snapshotPath = path;
+    _snapshotInterval = path.empty() ? 0 : interval;
+}
+
+void Server::setTrace(const std::string &path)
+{
+    if (path == _trace.path())
+        return;
+    _trace.close();
+    if (!path.empty() && !_trace.open(path, currentTimeMs()))
+        std::cerr << "Trace: cannot open " << path << std::endl;
+}
+
+void Server::writeChannelState(SnapshotWriter &writer, Channel *channel)
+{
+    writer.putString(channel->getTopic());
+    writer.putString(channel->getKey());
+    writer.putU8(channel->getModes());
+    writer.putI32(channel->getUserLimit());
+
+    std::vector<std::string> banList = channel->getBanList();
+    writer.putU32(static_cast<uint32_t>(banList.size()));
+    for (std::vector<std::string>::iterator ban = banList.begin(); ban != banList.end(); ++ban)
+        writer.putString(*ban);
+
+    const std::set<std::string> &invitations = channel->getInvitations();
+    writer.putU32(static_cast<uint32_t>(invitations.size()));
+    for (std::set<std::string>::const_iterator nick = invitations.begin(); nick != invitations.end(); ++nick)
+        writer.putString(*nick);
+}
+
+bool Server::saveSnapshot()
+{
+    if (_snapshotPath.empty())
+        return false;
+
+    SnapshotWriter writer;
+    writer.putU32(static_cast<uint32_t>(_channels.size()));
+    for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+    {
+        writer.putString(it->first);
+        writeChannelState(writer, it->second);
+    }
+    std::string data = writer.finish(SNAPSHOT_VERSION);
+
+    std::string tmpPath = _snapshotPath + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        std::cerr << "Snapshot: cannot open " << tmpPath << std::endl;
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n <= 0)
+        {
+            std::cerr << "Snapshot: write error on " << tmpPath << std::endl;
+            close(fd);
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        written += n;
+    }
+    fsync(fd);
+    close(fd);
+
+    if (std::rename(tmpPath.c_str(), _snapshotPath.c_str()) != 0)
+    {
+        std::cerr << "Snapshot: cannot replace " << _snapshotPath << std::endl;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    std::cout << "Snapshot saved: " << _channels.size() << " channels" << std::endl;
+    return true;
+}
+
+void Server::dropEmptyChannels()
+{
+    std::map<std::string, Channel *>::iterator it = _channels.begin();
+    while (it != _channels.end())
+    {
+        if (it->second->getClientCount() > 0)
+        {
+            ++it;
+            continue;
+        }
+        std::cout << "Deleting restored channel nobody rejoined: " << it->first << std::endl;
+        delete it->second;
+        _channels.erase(it++);
+    }
+}
+
+bool Server::readChannelState(SnapshotReader &reader, Channel *channel)
+{
+    std::string topic;
+    std::string key;
+    uint8_t flags;
+    int32_t limit;
+    uint32_t count;
+    std::string value;
+
+    if (!reader.getString(topic) || !reader.getString(key) || !reader.getU8(flags) || !reader.getI32(limit))
+        return false;
+    channel->setTopic(topic);
+    channel->setKey(key);
+    channel->setModes(flags);
+    channel->setUserLimit(limit);
+
+    if (!reader.getU32(count))
+        return false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (!reader.getString(value))
+            return false;
+        channel->addBan(value);
+    }
+
+    if (!reader.getU32(count))
+        return false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (!reader.getString(value))
+            return false;
+        channel->addInvitation(value);
+    }
+    return true;
+}
+
+bool Server::loadSnapshot()
+{
+    if (_snapshotPath.empty())
+        return false;
+
+    int fd = open(_snapshotPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "Snapshot: cannot map " << _snapshotPath << std::endl;
+        return false;
+    }
+
+    SnapshotReader reader(static_cast<const char *>(map), st.st_size);
+    uint32_t count = 0;
+    bool legacy = false;
+    bool ok = (reader.open(SNAPSHOT_VERSION) || (legacy = reader.open(1))) && reader.getU32(count);
+
+    std::string name;
+    for (uint32_t i = 0; ok && i < count; ++i)
+    {
+        ok = reader.getString(name) && !name.empty() && name[0] == '#' && !findChannel(name);
+        if (!ok)
+            break;
+        Channel *channel = createChannel(name);
+        ok = readChannelState(reader, channel);
+        if (legacy)
+            channel->setMode(CHANNEL_NO_EXTERNAL, true);
+    }
+    ok = ok && reader.atEnd();
+    munmap(map, st.st_size);
+
+    if (!ok)
+    {
+        std::cerr << "Snapshot: " << _snapshotPath << " is invalid, ignoring it" << std::endl;
+        for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+            delete it->second;
+        _channels.clear();
+        return false;
+    }
+
+    std::cout << "Snapshot restored: " << count << " channels" << std::endl;
+    return true;
+}
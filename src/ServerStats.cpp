@@ -0,0 +1,224 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Metrics.hpp"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+void Server::setMetricsSocket(const std::string &path)
+{
+    _metricsPath = path;
+}
+
+void Server::handleOper(Client *client, const std::vector<std::string> &args)
+{
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+
+    if (args.size() < 3)
+    {
+        client->sendMessage(":localhost 461 " + client->getNickname() + " OPER :Not enough parameters\r\n");
+        return;
+    }
+
+    std::map<std::string, std::string>::const_iterator it = _config->opers.find(args[1]);
+    if (it == _config->opers.end())
+    {
+        client->sendMessage(":localhost 491 " + client->getNickname() + " :No O-lines for your host\r\n");
+        return;
+    }
+    if (it->second != args[2])
+    {
+        client->sendMessage(":localhost 464 " + client->getNickname() + " :Password incorrect\r\n");
+        return;
+    }
+
+    client->setOper(true);
+    _users.setFlags(client, userFlags(client));
+    client->sendMessage(":localhost 381 " + client->getNickname() + " :You are now an IRC operator\r\n");
+    std::cout << "[" << client->getFd() << "] " << client->getNickname() << " is now an operator" << std::endl;
+}
+
+void Server::handleStats(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isOper())
+    {
+        client->sendMessage(":localhost 481 " + nickname + " :Permission Denied- You're not an IRC operator\r\n");
+        return;
+    }
+
+    std::string query = (args.size() > 1) ? args[1].substr(0, 1) : "*";
+    std::ostringstream reply;
+
+    if (query == "m")
+    {
+        const std::map<std::string, Histogram> &commands = g_metrics.getCommands();
+        for (std::map<std::string, Histogram>::const_iterator it = commands.begin(); it != commands.end(); ++it)
+        {
+            reply << ":localhost 212 " << nickname << " " << it->first << " " << it->second.count
+                  << " " << it->second.sum << " 0\r\n";
+        }
+    }
+    else if (query == "u")
+    {
+        unsigned long long uptime = (Metrics::nowUsec() - g_metrics.getStartTime()) / 1000000ULL;
+        reply << ":localhost 242 " << nickname << " :Server Up " << uptime / 86400 << " days "
+              << (uptime / 3600) % 24 << ":" << std::setfill('0') << std::setw(2) << (uptime / 60) % 60
+              << ":" << std::setw(2) << uptime % 60 << "\r\n";
+    }
+    else if (query == "z")
+    {
+        size_t queued = 0;
+        for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+            queued += it->second->_buffer.size();
+
+        const Histogram &loop = g_metrics.getLoop();
+        reply << ":localhost 249 " << nickname << " z :clients " << _clients.size() << " channels " << _channels.size()
+              << " queued " << queued << "\r\n";
+        reply << ":localhost 249 " << nickname << " z :bytes in " << g_metrics.getBytesIn()
+              << " out " << g_metrics.getBytesOut() << "\r\n";
+        reply << ":localhost 249 " << nickname << " z :connections opened " << g_metrics.getConnectionsOpened()
+              << " closed " << g_metrics.getConnectionsClosed() << "\r\n";
+        reply << ":localhost 249 " << nickname << " z :loop iterations " << loop.count << " avg "
+              << (loop.count ? loop.sum / loop.count : 0) << "us\r\n";
+    }
+    reply << ":localhost 219 " << nickname << " " << query << " :End of /STATS report\r\n";
+    client->sendMessage(reply.str());
+}
+
+void Server::openMetricsSocket()
+{
+    if (_metricsPath.empty())
+        return;
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (_metricsPath.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Metrics socket path too long" << std::endl;
+        return;
+    }
+    std::strcpy(addr.sun_path, _metricsPath.c_str());
+
+    _metrics_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_metrics_fd < 0)
+    {
+        std::cerr << "Metrics socket could not be created" << std::endl;
+        return;
+    }
+    fcntl(_metrics_fd, F_SETFL, O_NONBLOCK);
+    fcntl(_metrics_fd, F_SETFD, FD_CLOEXEC);
+
+    if (!clearStaleSocket(_metricsPath) || bind(_metrics_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(_metrics_fd, 4) < 0)
+    {
+        std::cerr << "Metrics socket bind error" << std::endl;
+        close(_metrics_fd);
+        _metrics_fd = -1;
+        return;
+    }
+
+    FD_SET(_metrics_fd, &_master_set);
+    if (_metrics_fd > _fd_max)
+        _fd_max = _metrics_fd;
+    std::cout << "Metrics available on " << _metricsPath << std::endl;
+}
+
+void Server::closeFd(int fd)
+{
+    close(fd);
+    FD_CLR(fd, &_master_set);
+    while (_fd_max > 0 && !FD_ISSET(_fd_max, &_master_set))
+        --_fd_max;
+}
+
+void Server::handleMetricsRequest(int fd)
+{
+    if (fd == _metrics_fd)
+    {
+        int conn = accept(_metrics_fd, NULL, NULL);
+        if (conn < 0)
+            return;
+        if (conn >= FD_SETSIZE)
+        {
+            close(conn);
+            return;
+        }
+        fcntl(conn, F_SETFL, O_NONBLOCK);
+        fcntl(conn, F_SETFD, FD_CLOEXEC);
+        _metricsConns[conn].opened = currentTimeMs();
+        FD_SET(conn, &_master_set);
+        if (conn > _fd_max)
+            _fd_max = conn;
+        return;
+    }
+
+    char buf[1024];
+    ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    MetricsConn &conn = _metricsConns[fd];
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        _metricsConns.erase(fd);
+        closeFd(fd);
+        return;
+    }
+    if (!conn.output.empty())
+        return;
+
+    size_t queued = 0;
+    for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+        queued += it->second->_buffer.size();
+
+    std::string body = g_metrics.prometheus(_clients.size(), _channels.size(), queued);
+    std::ostringstream response;
+    response << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+             << body.size() << "\r\n\r\n" << body;
+    conn.output = response.str();
+    flushMetrics(fd);
+}
+
+void Server::flushMetrics(int fd)
+{
+    MetricsConn &conn = _metricsConns[fd];
+    ssize_t sent = send(fd, conn.output.data(), conn.output.size(), MSG_NOSIGNAL);
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (sent > 0 && static_cast<size_t>(sent) < conn.output.size())
+    {
+        conn.output.erase(0, sent);
+        return;
+    }
+    _metricsConns.erase(fd);
+    closeFd(fd);
+}
+
+long long Server::expireMetrics(long long now)
+{
+    long long next = 0;
+    std::map<int, MetricsConn>::iterator it = _metricsConns.begin();
+    while (it != _metricsConns.end())
+    {
+        long long expiry = it->second.opened + METRICS_IDLE_TIMEOUT;
+        if (expiry <= now)
+        {
+            closeFd(it->first);
+            _metricsConns.erase(it++);
+            continue;
+        }
+        if (!next || expiry < next)
+            next = expiry;
+        ++it;
+    }
+    return next;
+}
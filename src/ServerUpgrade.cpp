@@ -0,0 +1,575 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Snapshot.hpp"
+#include "WebSocket.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define UPGRADE_VERSION 10
+#define UPGRADE_FDS_PER_MESSAGE 200
+#define UPGRADE_ACK_TIMEOUT_MS 10000
+
+static bool writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = read(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool sendFds(int sock, const std::vector<int> &fds)
+{
+    for (size_t sent = 0; sent < fds.size(); sent += UPGRADE_FDS_PER_MESSAGE)
+    {
+        size_t count = std::min(fds.size() - sent, static_cast<size_t>(UPGRADE_FDS_PER_MESSAGE));
+        std::vector<char> control(CMSG_SPACE(count * sizeof(int)));
+        char byte = 'F';
+        iovec iov;
+        iov.iov_base = &byte;
+        iov.iov_len = 1;
+
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = &control[0];
+        msg.msg_controllen = control.size();
+
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fds[sent], count * sizeof(int));
+
+        if (sendmsg(sock, &msg, 0) != 1)
+            return false;
+    }
+    return true;
+}
+
+static bool receiveFds(int sock, size_t total, std::vector<int> &fds)
+{
+    while (fds.size() < total)
+    {
+        size_t count = std::min(total - fds.size(), static_cast<size_t>(UPGRADE_FDS_PER_MESSAGE));
+        std::vector<char> control(CMSG_SPACE(count * sizeof(int)));
+        char byte;
+        iovec iov;
+        iov.iov_base = &byte;
+        iov.iov_len = 1;
+
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = &control[0];
+        msg.msg_controllen = control.size();
+
+        if (recvmsg(sock, &msg, 0) != 1)
+            return false;
+
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            return false;
+
+        size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *data = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        for (size_t i = 0; i < received; ++i)
+        {
+            fcntl(data[i], F_SETFD, FD_CLOEXEC);
+            fds.push_back(data[i]);
+        }
+        if (received != count)
+            return false;
+    }
+    return true;
+}
+
+void Server::setBinaryPath(const std::string &path)
+{
+    _binaryPath = path;
+}
+
+bool Server::upgrade()
+{
+    if (_binaryPath.empty())
+        return false;
+    flushJoins();
+
+    std::vector<Client *> encrypted;
+    for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+    {
+        if (it->second->_tls)
+            encrypted.push_back(it->second);
+    }
+    for (std::vector<Client *>::iterator it = encrypted.begin(); it != encrypted.end(); ++it)
+    {
+        Client *client = *it;
+        if (client->isRegistered() && !client->getNickname().empty())
+        {
+            std::string quitMsg = ":" + client->getNickname() + "!user@localhost QUIT :Server upgrade\r\n";
+            const std::vector<Channel *> &joined = client->getChannels();
+            for (std::vector<Channel *>::const_iterator channel = joined.begin(); channel != joined.end(); ++channel)
+                (*channel)->broadcast(quitMsg, client);
+        }
+        client->sendMessage("ERROR :Server upgrade, please reconnect\r\n");
+        client->flush();
+        removeClient(client, "Server upgrade");
+    }
+
+    std::cout << "Upgrading: handing " << _clients.size() << " connections to " << _binaryPath << std::endl;
+
+    std::vector<int> fds;
+    std::map<Client *, uint32_t> indexes;
+
+    SnapshotWriter writer;
+    writer.putU32(static_cast<uint32_t>(_port));
+    writer.putString(_password);
+    writer.putU64(static_cast<uint64_t>(_startTime));
+    writer.putU64(_msgidSeq);
+    writer.putU64(_batchSeq);
+    writer.putString(_snapshotPath);
+    writer.putI32(_snapshotInterval);
+
+    std::map<int, int32_t> listenerIndexes;
+    writer.putU32(static_cast<uint32_t>(_listeners.size()));
+    for (std::vector<Listener>::iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+    {
+        listenerIndexes[it->fd] = static_cast<int32_t>(fds.size());
+        fds.push_back(it->fd);
+        writer.putString(it->address);
+        writer.putU8((it->trusted ? 1 : 0) | (it->tls ? 2 : 0) | (it->websocket ? 4 : 0));
+        writer.putU64(it->maxClients);
+        writer.putU64(it->sendq);
+    }
+
+    writer.putU32(static_cast<uint32_t>(_clients.size()));
+    for (std::map<int, Client *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+    {
+        Client *client = it->second;
+        uint32_t index = static_cast<uint32_t>(indexes.size());
+        indexes[client] = index;
+        fds.push_back(client->getFd());
+
+        writer.putString(client->getNickname());
+        writer.putString(client->getUsername());
+        writer.putString(client->getRealname());
+        writer.putU8((client->isAuthenticated() ? 1 : 0) | (client->isRegistered() ? 2 : 0) | (client->isCapNegotiating() ? 4 : 0)
+                      | (client->isOper() ? 8 : 0) | (client->isServer() ? 16 : 0) | (client->_callerid ? 32 : 0));
+        writer.putU32(client->getCaps());
+        writer.putU64(static_cast<uint64_t>(client->getNickTs()));
+        std::map<int, int32_t>::iterator listener = listenerIndexes.find(client->_listener);
+        writer.putI32(listener != listenerIndexes.end() ? listener->second : -1);
+        writer.putU64(client->_sendq);
+        writer.putU8(client->_ws ? 1 : 0);
+        if (client->_ws)
+            client->_ws->save(writer);
+        writer.putString(client->_buffer);
+        writer.putString(client->_outbuf);
+        std::map<int, std::string>::iterator peer = _linkPeers.find(client->getFd());
+        writer.putString(peer != _linkPeers.end() ? peer->second : "");
+        writer.putU32(static_cast<uint32_t>(client->_monitoring.size()));
+        for (std::map<std::string, std::string>::iterator it = client->_monitoring.begin(); it != client->_monitoring.end(); ++it)
+            writer.putString(it->second);
+        writer.putU32(static_cast<uint32_t>(client->_silence.size()));
+        for (std::set<std::string>::iterator it = client->_silence.begin(); it != client->_silence.end(); ++it)
+            writer.putString(*it);
+        writer.putU32(static_cast<uint32_t>(client->_accepted.size()));
+        for (std::map<std::string, std::string>::iterator it = client->_accepted.begin(); it != client->_accepted.end(); ++it)
+            writer.putString(it->second);
+        writer.putString(client->getAway());
+    }
+
+    std::vector<Client *> remotes;
+    for (std::map<std::string, Client *>::iterator it = _clients_by_nick.begin(); it != _clients_by_nick.end(); ++it)
+    {
+        if (it->second->getUplink())
+            remotes.push_back(it->second);
+    }
+    writer.putU32(static_cast<uint32_t>(remotes.size()));
+    for (std::vector<Client *>::iterator it = remotes.begin(); it != remotes.end(); ++it)
+    {
+        uint32_t index = static_cast<uint32_t>(indexes.size());
+        writer.putU32(indexes[(*it)->getUplink()]);
+        indexes[*it] = index;
+        writer.putString((*it)->getNickname());
+        writer.putString((*it)->getUsername());
+        writer.putString((*it)->getRealname());
+        writer.putU64(static_cast<uint64_t>((*it)->getNickTs()));
+        writer.putString((*it)->getOrigin());
+        writer.putString((*it)->getAway());
+    }
+
+    writer.putU32(static_cast<uint32_t>(_servers.size()));
+    for (std::map<std::string, Client *>::iterator it = _servers.begin(); it != _servers.end(); ++it)
+    {
+        writer.putString(it->first);
+        writer.putU32(indexes[it->second]);
+    }
+
+    writer.putU32(static_cast<uint32_t>(_channels.size()));
+    for (std::map<std::string, Channel *>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+    {
+        Channel *channel = it->second;
+        writer.putString(it->first);
+        writeChannelState(writer, channel);
+
+        std::vector<Client *> members = channel->getClients();
+        writer.putU32(static_cast<uint32_t>(members.size()));
+        for (std::vector<Client *>::iterator member = members.begin(); member != members.end(); ++member)
+        {
+            writer.putU32(indexes[*member]);
+            writer.putU8(channel->getMemberModes(*member));
+        }
+
+        writer.putU32(static_cast<uint32_t>(channel->getHistoryLimit()));
+        writer.putU32(static_cast<uint32_t>(channel->getHistorySize()));
+        for (size_t i = 0; i < channel->getHistorySize(); ++i)
+        {
+            const HistoryEntry &entry = channel->getHistoryEntry(i);
+            writer.putU64(static_cast<uint64_t>(entry.time));
+            writer.putString(entry.msgid);
+            writer.putString(entry.line);
+        }
+    }
+    std::string data = writer.finish(UPGRADE_VERSION);
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        std::cerr << "Upgrade: socketpair failed" << std::endl;
+        return false;
+    }
+    fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+    _trace.close();
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        std::cerr << "Upgrade: fork failed" << std::endl;
+        close(sv[0]);
+        close(sv[1]);
+        setTrace(_config->tracePath);
+        return false;
+    }
+    if (pid == 0)
+    {
+        char fdArg[16];
+        std::snprintf(fdArg, sizeof(fdArg), "%d", sv[1]);
+        const char *config = _config->path.empty() ? NULL : _config->path.c_str();
+        execl(_binaryPath.c_str(), _binaryPath.c_str(), "--upgrade", fdArg, config, static_cast<char *>(NULL));
+        _exit(127);
+    }
+    close(sv[1]);
+
+    uint32_t header[2] = {static_cast<uint32_t>(fds.size()), static_cast<uint32_t>(data.size())};
+    bool ok = writeAll(sv[0], reinterpret_cast<const char *>(header), sizeof(header))
+        && writeAll(sv[0], data.data(), data.size())
+        && sendFds(sv[0], fds);
+
+    char ack = 0;
+    if (ok)
+    {
+        pollfd pfd;
+        pfd.fd = sv[0];
+        pfd.events = POLLIN;
+        ok = poll(&pfd, 1, UPGRADE_ACK_TIMEOUT_MS) == 1 && read(sv[0], &ack, 1) == 1 && ack == 'K';
+    }
+    close(sv[0]);
+
+    if (!ok)
+    {
+        std::cerr << "Upgrade: new process did not take over, continuing" << std::endl;
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        setTrace(_config->tracePath);
+        return false;
+    }
+
+    if (_metrics_fd >= 0)
+    {
+        close(_metrics_fd);
+        _metrics_fd = -1;
+    }
+    closeListeners(false);
+    std::cout << "Upgrade: handed over to pid " << pid << std::endl;
+    return true;
+}
+
+bool Server::restoreUpgradeState(SnapshotReader &reader, const std::vector<int> &fds)
+{
+    uint32_t port;
+    uint64_t startTime;
+    uint64_t msgidSeq;
+    uint64_t batchSeq;
+    int32_t snapshotInterval;
+    uint32_t listeners;
+    uint32_t count;
+
+    if (!reader.getU32(port) || !reader.getString(_password) || !reader.getU64(startTime)
+        || !reader.getU64(msgidSeq) || !reader.getU64(batchSeq) || !reader.getString(_snapshotPath)
+        || !reader.getI32(snapshotInterval) || !reader.getU32(listeners)
+        || listeners > fds.size())
+        return false;
+
+    FD_ZERO(&_master_set);
+    _fd_max = 0;
+    for (uint32_t i = 0; i < listeners; ++i)
+    {
+        Listener listener;
+        uint8_t flags;
+        uint64_t maxClients;
+        uint64_t sendq;
+        if (!reader.getString(listener.address) || !reader.getU8(flags) || !reader.getU64(maxClients)
+            || !reader.getU64(sendq))
+            return false;
+        listener.fd = fds[i];
+        listener.trusted = flags & 1;
+        listener.tls = flags & 2;
+        listener.websocket = flags & 4;
+        listener.maxClients = maxClients;
+        listener.sendq = sendq;
+        _listeners.push_back(listener);
+        FD_SET(listener.fd, &_master_set);
+        if (listener.fd > _fd_max)
+            _fd_max = listener.fd;
+    }
+
+    if (!reader.getU32(count) || listeners + count != fds.size())
+        return false;
+
+    _port = port;
+    _startTime = static_cast<long long>(startTime);
+    _msgidSeq = msgidSeq;
+    _batchSeq = batchSeq;
+    _snapshotInterval = snapshotInterval;
+
+    std::vector<Client *> clients;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Client *client = new Client(fds[listeners + i]);
+        clients.push_back(client);
+        _clients[client->getFd()] = client;
+        FD_SET(client->getFd(), &_master_set);
+        if (client->getFd() > _fd_max)
+            _fd_max = client->getFd();
+
+        std::string nickname;
+        std::string peer;
+        uint8_t flags;
+        uint32_t caps;
+        uint64_t nickTs;
+        int32_t listener;
+        uint64_t sendq;
+        uint8_t websocket;
+        if (!reader.getString(nickname) || !reader.getString(client->_username) || !reader.getString(client->_realname)
+            || !reader.getU8(flags) || !reader.getU32(caps) || !reader.getU64(nickTs)
+            || !reader.getI32(listener) || listener >= static_cast<int32_t>(listeners) || !reader.getU64(sendq) || !reader.getU8(websocket))
+            return false;
+        if (websocket)
+        {
+            client->_ws = new WebSocket();
+            if (!client->_ws->restore(reader))
+                return false;
+        }
+        if (!reader.getString(client->_buffer) || !reader.getString(client->_outbuf) || !reader.getString(peer))
+            return false;
+
+        client->setNickname(nickname);
+        client->setAuthenticated(flags & 1);
+        client->setRegistered(flags & 2);
+        client->setCapNegotiating(flags & 4);
+        client->setOper(flags & 8);
+        client->setServer(flags & 16);
+        client->_callerid = flags & 32;
+        client->setCaps(caps);
+        client->setNickTs(static_cast<long>(nickTs));
+        client->_sendq = sendq;
+        if (listener >= 0)
+        {
+            client->_listener = _listeners[listener].fd;
+            ++_listeners[listener].clients;
+        }
+        if (!nickname.empty())
+            _clients_by_nick[foldNick(nickname)] = client;
+        if (!nickname.empty() && client->isRegistered() && !client->isServer())
+            _users.insert(client, foldNick(nickname), userFlags(client));
+        if (!peer.empty())
+            _linkPeers[client->getFd()] = peer;
+
+        uint32_t monitors;
+        if (!reader.getU32(monitors))
+            return false;
+        for (uint32_t m = 0; m < monitors; ++m)
+        {
+            std::string target;
+            if (!reader.getString(target))
+                return false;
+            client->_monitoring[foldNick(target)] = target;
+            _watchers[foldNick(target)].insert(client);
+            ++_monitorTotal;
+        }
+
+        uint32_t entries;
+        if (!reader.getU32(entries))
+            return false;
+        for (uint32_t e = 0; e < entries; ++e)
+        {
+            std::string mask;
+            if (!reader.getString(mask))
+                return false;
+            client->_silence.insert(mask);
+            if (!silenceNick(mask).empty())
+                client->_silenceNicks.insert(silenceNick(mask));
+        }
+        if (!reader.getU32(entries))
+            return false;
+        for (uint32_t e = 0; e < entries; ++e)
+        {
+            std::string nick;
+            if (!reader.getString(nick))
+                return false;
+            client->_accepted[foldNick(nick)] = nick;
+        }
+        if (!reader.getString(client->_away))
+            return false;
+    }
+
+    size_t localCount = clients.size();
+    if (!reader.getU32(count))
+        return false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t uplink;
+        std::string nickname;
+        std::string origin;
+        uint64_t nickTs;
+        Client *remote = new Client(-1);
+        clients.push_back(remote);
+        if (!reader.getU32(uplink) || uplink >= localCount || !reader.getString(nickname)
+            || !reader.getString(remote->_username) || !reader.getString(remote->_realname) || !reader.getU64(nickTs)
+            || !reader.getString(origin) || !reader.getString(remote->_away))
+            return false;
+
+        remote->setNickname(nickname);
+        remote->setNickTs(static_cast<long>(nickTs));
+        remote->setAuthenticated(true);
+        remote->setRegistered(true);
+        remote->setUplink(clients[uplink]);
+        remote->setOrigin(origin);
+        _clients_by_nick[foldNick(nickname)] = remote;
+        _users.insert(remote, foldNick(nickname), userFlags(remote));
+    }
+
+    if (!reader.getU32(count))
+        return false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        std::string name;
+        uint32_t link;
+        if (!reader.getString(name) || !reader.getU32(link) || link >= localCount)
+            return false;
+        _servers[name] = clients[link];
+    }
+
+    if (!reader.getU32(count))
+        return false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        std::string name;
+        if (!reader.getString(name) || findChannel(name))
+            return false;
+
+        Channel *channel = createChannel(name);
+        uint32_t members;
+        if (!readChannelState(reader, channel) || !reader.getU32(members))
+            return false;
+        for (uint32_t m = 0; m < members; ++m)
+        {
+            uint32_t index;
+            uint8_t modes;
+            if (!reader.getU32(index) || !reader.getU8(modes) || index >= clients.size())
+                return false;
+            channel->addClient(clients[index]);
+            channel->setMemberMode(clients[index], modes, true);
+        }
+
+        uint32_t historyLimit;
+        uint32_t entries;
+        if (!reader.getU32(historyLimit) || !reader.getU32(entries))
+            return false;
+        channel->setHistoryLimit(historyLimit);
+        for (uint32_t e = 0; e < entries; ++e)
+        {
+            HistoryEntry entry;
+            uint64_t time;
+            if (!reader.getU64(time) || !reader.getString(entry.msgid) || !reader.getString(entry.line))
+                return false;
+            channel->addHistory(static_cast<long long>(time), entry.msgid, entry.line);
+        }
+    }
+    return reader.atEnd();
+}
+
+void Server::resume(int channel_fd)
+{
+    uint32_t header[2];
+    std::vector<int> fds;
+    std::string data;
+
+    bool ok = readAll(channel_fd, reinterpret_cast<char *>(header), sizeof(header));
+    if (ok)
+    {
+        data.resize(header[1]);
+        ok = header[0] > 0 && (data.empty() || readAll(channel_fd, &data[0], data.size()))
+            && receiveFds(channel_fd, header[0], fds);
+    }
+
+    if (ok)
+    {
+        SnapshotReader reader(data.data(), data.size());
+        ok = reader.open(UPGRADE_VERSION) && restoreUpgradeState(reader, fds);
+    }
+
+    if (!ok)
+    {
+        std::cerr << "Upgrade: could not restore state from previous process" << std::endl;
+        close(channel_fd);
+        return;
+    }
+
+    write(channel_fd, "K", 1);
+    close(channel_fd);
+
+    openMetricsSocket();
+    std::cout << "IRC Server resumed on port " << _port << " with " << _clients.size() << " connections" << std::endl;
+    serve();
+}
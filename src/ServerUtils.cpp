@@ -1,15 +1,20 @@
 #include "Server.hpp"
 #include "Client.hpp"
 #include "Channel.hpp"
+#include "Platform.hpp"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <ctime>
 
-std::vector<std::string> Server::splitCommand(const std::string &command)
+std::vector<std::string> Server::splitCommand(const std::string &command, size_t offset)
 {
     std::vector<std::string> args;
-    size_t start = 0;
-    size_t pos = 0;
+    size_t start = offset;
+    size_t pos = offset;
 
     while (pos < command.length())
     {
@@ -36,7 +41,7 @@ std::vector<std::string> Server::splitCommand(const std::string &command)
         pos++;
     }
 
-    if (start < command.length() && (start == 0 || command[start] != ':'))
+    if (start < command.length() && (start == offset || command[start] != ':'))
     {
         std::string arg = command.substr(start);
         if (!arg.empty())
@@ -50,7 +55,7 @@ std::vector<std::string> Server::splitCommand(const std::string &command)
 
 Client *Server::findClientByNickname(const std::string &nickname)
 {
-    std::map<std::string, Client *>::iterator it = _clients_by_nick.find(nickname);
+    std::map<std::string, Client *>::iterator it = _clients_by_nick.find(foldNick(nickname));
     return (it != _clients_by_nick.end()) ? it->second : NULL;
 }
 
@@ -60,19 +65,161 @@ Channel *Server::findChannel(const std::string &name)
     return (it != _channels.end()) ? it->second : NULL;
 }
 
+bool Server::matchMask(const std::string &mask, const std::string &value)
+{
+    size_t m = 0;
+    size_t v = 0;
+    size_t star = std::string::npos;
+    size_t resume = 0;
+
+    while (v < value.size())
+    {
+        if (m < mask.size() && (mask[m] == '?' || std::tolower(mask[m]) == std::tolower(value[v])))
+        {
+            ++m;
+            ++v;
+        }
+        else if (m < mask.size() && mask[m] == '*')
+        {
+            star = m++;
+            resume = v;
+        }
+        else if (star != std::string::npos)
+        {
+            m = star + 1;
+            v = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (m < mask.size() && mask[m] == '*')
+        ++m;
+    return m == mask.size();
+}
+
 Channel *Server::createChannel(const std::string &name)
 {
     Channel *channel = new Channel(name);
+    channel->setHistoryLimit(_config->historyLimit);
+    channel->setMode(CHANNEL_NO_EXTERNAL, true);
     _channels[name] = channel;
     return channel;
 }
 
+void Server::completeRegistration(Client *client)
+{
+    if (client->isRegistered() || client->isCapNegotiating() || client->getUsername().empty())
+        return;
+
+    client->setRegistered(true);
+    if (!client->getNickname().empty())
+    {
+        sendWelcome(client);
+        handleMotd(client, std::vector<std::string>());
+        introduceClient(client);
+        _users.insert(client, foldNick(client->getNickname()), userFlags(client));
+        notifyMonitors(client->getNickname(), client);
+    }
+}
+
 void Server::sendWelcome(Client *client)
 {
     std::string nickname = client->getNickname();
+    std::ostringstream limit;
+    limit << _config->historyLimit;
+    std::ostringstream monitor;
+    monitor << _config->monitorLimit;
+    std::ostringstream modes;
+    modes << MODE_LINE_LIMIT;
+    std::ostringstream silence;
+    silence << SILENCE_LIMIT;
+    std::ostringstream away;
+    away << AWAY_LENGTH;
+    std::ostringstream targets;
+    targets << MESSAGE_TARGETS;
     client->sendMessage(":localhost 001 " + nickname + " :Welcome to the Internet Relay Network " + nickname + "!user@localhost\r\n");
     client->sendMessage(":localhost 002 " + nickname + " :Your host is localhost, running version 1.0\r\n");
     client->sendMessage(":localhost 003 " + nickname + " :This server was created today\r\n");
-    client->sendMessage(":localhost 004 " + nickname + " localhost 1.0 oiws biklmnopstv\r\n");
-    client->sendMessage(":localhost 005 " + nickname + " CHANTYPES=# PREFIX=(ov)@+ NETWORK=LocalIRC :are supported by this server\r\n");
+    client->sendMessage(":localhost 004 " + nickname + " localhost 1.0 giows biklmnopstv\r\n");
+    client->sendMessage(":localhost 005 " + nickname + " CHANTYPES=# CHANMODES=b,k,l,imnpst MODES=" + modes.str() + " CHATHISTORY=" + limit.str() + " MSGREFTYPES=timestamp,msgid ELIST=MNTU SAFELIST MONITOR=" + monitor.str() + " SILENCE=" + silence.str() + " CALLERID=g AWAYLEN=" + away.str() + " TARGMAX=PRIVMSG:" + targets.str() + ",NOTICE:" + targets.str() + " PREFIX=(ov)@+ NETWORK=LocalIRC :are supported by this server\r\n");
+}
+
+std::string Server::messageTags(long long &time, std::string &msgid)
+{
+    time = currentTimeMs();
+    msgid = nextMsgid();
+    std::string tags = "time=" + formatServerTime(time) + ";msgid=" + msgid;
+    if (!_clientTags.empty())
+        tags += ";" + _clientTags;
+    return tags;
+}
+
+std::string Server::nextMsgid()
+{
+    std::ostringstream oss;
+    oss << std::hex << _startTime << "-" << ++_msgidSeq;
+    return oss.str();
+}
+
+std::string Server::nextBatchRef()
+{
+    std::ostringstream oss;
+    oss << "b" << std::hex << ++_batchSeq;
+    return oss.str();
+}
+
+long long Server::currentTimeMs()
+{
+    return g_platform->now();
+}
+
+std::string Server::formatServerTime(long long ms)
+{
+    time_t seconds = static_cast<time_t>(ms / 1000);
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                  tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                  tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(ms % 1000));
+    return buf;
+}
+
+bool Server::parseServerTime(const std::string &text, long long &ms)
+{
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    int millis = 0;
+    int consumed = 0;
+
+    if (std::sscanf(text.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%n",
+                    &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                    &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &consumed) != 6)
+        return false;
+
+    const char *rest = text.c_str() + consumed;
+    if (*rest == '.')
+    {
+        ++rest;
+        int digits = 0;
+        while (*rest >= '0' && *rest <= '9')
+        {
+            if (digits < 3)
+                millis = millis * 10 + (*rest - '0');
+            ++digits;
+            ++rest;
+        }
+        for (; digits < 3; ++digits)
+            millis *= 10;
+    }
+    if (*rest != 'Z' || rest[1] != '\0')
+        return false;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    ms = static_cast<long long>(timegm(&tm)) * 1000 + millis;
+    return true;
 }
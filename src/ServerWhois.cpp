@@ -0,0 +1,333 @@
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+
+std::string Server::foldNick(const std::string &nickname)
+{
+    std::string folded(nickname);
+    for (std::string::iterator it = folded.begin(); it != folded.end(); ++it)
+    {
+        if (*it >= 'A' && *it <= 'Z')
+            *it = *it - 'A' + 'a';
+        else if (*it == '[')
+            *it = '{';
+        else if (*it == ']')
+            *it = '}';
+        else if (*it == '\\')
+            *it = '|';
+        else if (*it == '~')
+            *it = '^';
+    }
+    return folded;
+}
+
+const std::string &Server::originOf(Client *client) const
+{
+    return client->getOrigin().empty() ? _serverName : client->getOrigin();
+}
+
+unsigned char Server::userFlags(Client *client) const
+{
+    return (client->isOper() ? USER_OPER : 0) | (client->getUplink() ? USER_REMOTE : 0);
+}
+
+void Server::recordWhowas(Client *client)
+{
+    if (client->getNickname().empty() || !client->isRegistered() || client->isServer())
+        return;
+
+    WhowasEntry entry;
+    entry.nickname = client->getNickname();
+    entry.username = client->getUsername();
+    entry.realname = client->getRealname();
+    entry.server = originOf(client);
+    entry.time = currentTimeMs() / 1000;
+
+    size_t slot = _whowasNext;
+    if (_whowas.size() < WHOWAS_LIMIT)
+    {
+        _whowas.push_back(entry);
+    }
+    else
+    {
+        std::pair<std::multimap<std::string, size_t>::iterator, std::multimap<std::string, size_t>::iterator> range =
+            _whowasIndex.equal_range(foldNick(_whowas[slot].nickname));
+        for (std::multimap<std::string, size_t>::iterator it = range.first; it != range.second; ++it)
+        {
+            if (it->second == slot)
+            {
+                _whowasIndex.erase(it);
+                break;
+            }
+        }
+        _whowas[slot] = entry;
+    }
+    _whowasIndex.insert(std::make_pair(foldNick(entry.nickname), slot));
+    _whowasNext = (slot + 1) % WHOWAS_LIMIT;
+}
+
+void Server::handleWhois(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 431 " + nickname + " :No nickname given\r\n");
+        return;
+    }
+
+    std::stringstream targets(args.back()[0] == ':' ? args.back().substr(1) : args.back());
+    std::ostringstream reply;
+    std::string target;
+    while (std::getline(targets, target, ','))
+    {
+        if (target.empty())
+            continue;
+
+        Client *user = findClientByNickname(target);
+        if (!user)
+        {
+            reply << ":localhost 401 " << nickname << " " << target << " :No such nick/channel\r\n";
+            reply << ":localhost 318 " << nickname << " " << target << " :End of /WHOIS list\r\n";
+            continue;
+        }
+
+        std::string username = user->getUsername().empty() ? "user" : user->getUsername();
+        reply << ":localhost 311 " << nickname << " " << user->getNickname() << " " << username
+              << " localhost * :" << user->getRealname() << "\r\n";
+
+        const std::vector<Channel *> &joined = user->getChannels();
+        if (!joined.empty())
+        {
+            std::string channels;
+            for (std::vector<Channel *>::const_iterator it = joined.begin(); it != joined.end(); ++it)
+            {
+                if ((*it)->hasMode(CHANNEL_SECRET | CHANNEL_PRIVATE) && !(*it)->hasClient(client))
+                    continue;
+                if (!channels.empty())
+                    channels += " ";
+                channels += (*it)->getMemberPrefix(user) + (*it)->getName();
+            }
+            if (!channels.empty())
+                reply << ":localhost 319 " << nickname << " " << user->getNickname() << " :" << channels << "\r\n";
+        }
+
+        reply << ":localhost 312 " << nickname << " " << user->getNickname() << " " << originOf(user) << " :ircserv\r\n";
+        if (user->isAway())
+            reply << ":localhost 301 " << nickname << " " << user->getNickname() << " :" << user->getAway() << "\r\n";
+        if (user->isOper())
+            reply << ":localhost 313 " << nickname << " " << user->getNickname() << " :is an IRC operator\r\n";
+        reply << ":localhost 318 " << nickname << " " << user->getNickname() << " :End of /WHOIS list\r\n";
+    }
+    client->sendMessage(reply.str());
+}
+
+void Server::handleWhowas(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 431 " + nickname + " :No nickname given\r\n");
+        return;
+    }
+
+    std::string target = args[1];
+    long limit = (args.size() > 2) ? std::atol(args[2].c_str()) : 0;
+
+    std::vector<std::pair<size_t, size_t> > matches;
+    std::pair<std::multimap<std::string, size_t>::iterator, std::multimap<std::string, size_t>::iterator> range =
+        _whowasIndex.equal_range(foldNick(target));
+    for (std::multimap<std::string, size_t>::iterator it = range.first; it != range.second; ++it)
+        matches.push_back(std::make_pair((_whowasNext + WHOWAS_LIMIT - 1 - it->second) % WHOWAS_LIMIT, it->second));
+    std::sort(matches.begin(), matches.end());
+
+    std::ostringstream reply;
+    if (matches.empty())
+        reply << ":localhost 406 " << nickname << " " << target << " :There was no such nickname\r\n";
+    for (size_t i = 0; i < matches.size() && (limit <= 0 || i < static_cast<size_t>(limit)); ++i)
+    {
+        const WhowasEntry &entry = _whowas[matches[i].second];
+        char when[64];
+        time_t stamp = entry.time;
+        strftime(when, sizeof(when), "%a %b %d %H:%M:%S %Y", gmtime(&stamp));
+        std::string username = entry.username.empty() ? "user" : entry.username;
+        reply << ":localhost 314 " << nickname << " " << entry.nickname << " " << username
+              << " localhost * :" << entry.realname << "\r\n";
+        reply << ":localhost 312 " << nickname << " " << entry.nickname << " " << entry.server << " :" << when << "\r\n";
+    }
+    reply << ":localhost 369 " << nickname << " " << target << " :End of WHOWAS\r\n";
+    client->sendMessage(reply.str());
+}
+
+void Server::handleIson(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 461 " + nickname + " ISON :Not enough parameters\r\n");
+        return;
+    }
+
+    std::string online;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        std::stringstream nicks(args[i][0] == ':' ? args[i].substr(1) : args[i]);
+        std::string target;
+        while (nicks >> target)
+        {
+            Client *user = findClientByNickname(target);
+            if (user)
+                online += (online.empty() ? "" : " ") + user->getNickname();
+        }
+    }
+    client->sendMessage(":localhost 303 " + nickname + " :" + online + "\r\n");
+}
+
+std::string Server::whoReply(Client *client, const std::string &channel, Client *user, const std::string &prefix,
+                             const std::string &fields, const std::string &token)
+{
+    std::string username = user->getUsername().empty() ? "user" : user->getUsername();
+    std::string realname = user->getRealname().empty() ? user->getNickname() : user->getRealname();
+    std::string flags = std::string(user->isAway() ? "G" : "H") + (user->isOper() ? "*" : "") + prefix;
+
+    if (fields.empty())
+    {
+        return ":localhost 352 " + client->getNickname() + " " + channel + " " + username + " localhost "
+            + originOf(user) + " " + user->getNickname() + " " + flags + " :0 " + realname + "\r\n";
+    }
+
+    std::string line = ":localhost 354 " + client->getNickname();
+    const char *order = "tcuihsnfdlaor";
+    for (const char *field = order; *field; ++field)
+    {
+        if (fields.find(*field) == std::string::npos)
+            continue;
+        switch (*field)
+        {
+        case 't': line += " " + token; break;
+        case 'c': line += " " + channel; break;
+        case 'u': line += " " + username; break;
+        case 'i': line += " 255.255.255.255"; break;
+        case 'h': line += " localhost"; break;
+        case 's': line += " " + originOf(user); break;
+        case 'n': line += " " + user->getNickname(); break;
+        case 'f': line += " " + flags; break;
+        case 'd': line += " 0"; break;
+        case 'l': line += " 0"; break;
+        case 'a': line += " 0"; break;
+        case 'o': line += " n/a"; break;
+        case 'r': line += " :" + realname; break;
+        }
+    }
+    return line + "\r\n";
+}
+
+void Server::handleWho(Client *client, const std::vector<std::string> &args)
+{
+    std::string nickname = client->getNickname();
+    if (!client->isRegistered())
+    {
+        client->sendMessage(":localhost 451 * :You have not registered\r\n");
+        return;
+    }
+    if (args.size() < 2)
+    {
+        client->sendMessage(":localhost 461 " + nickname + " WHO :Not enough parameters\r\n");
+        return;
+    }
+
+    std::string target = args[1];
+    std::string options = (args.size() > 2) ? args[2] : "";
+    if (!options.empty() && options[0] == ':')
+        options.erase(0, 1);
+    std::string fields;
+    std::string token;
+    size_t percent = options.find('%');
+    if (percent != std::string::npos)
+    {
+        fields = options.substr(percent + 1);
+        size_t comma = fields.find(',');
+        if (comma != std::string::npos)
+        {
+            token = fields.substr(comma + 1, 3);
+            fields.erase(comma);
+        }
+        if (fields.empty())
+            fields = "n";
+        options.erase(percent);
+    }
+    bool opersOnly = options.find('o') != std::string::npos;
+
+    std::ostringstream reply;
+    if (target[0] == '#')
+    {
+        Channel *channel = findChannel(target);
+        if (!channel)
+        {
+            client->sendMessage(":localhost 403 " + nickname + " " + target + " :No such channel\r\n");
+            return;
+        }
+        if (!channel->hasClient(client))
+        {
+            client->sendMessage(":localhost 442 " + nickname + " " + target + " :You're not on that channel\r\n");
+            return;
+        }
+
+        std::vector<Client *> clients = channel->getClients();
+        for (std::vector<Client *>::iterator it = clients.begin(); it != clients.end(); ++it)
+        {
+            if (!opersOnly || (*it)->isOper())
+                reply << whoReply(client, target, *it, channel->getMemberPrefix(*it), fields, token);
+        }
+    }
+    else if (target.find_first_of("*?") == std::string::npos)
+    {
+        Client *user = findClientByNickname(target);
+        if (!user)
+        {
+            client->sendMessage(":localhost 401 " + nickname + " " + target + " :No such nick/channel\r\n");
+            return;
+        }
+        if (!opersOnly || user->isOper())
+            reply << whoReply(client, "*", user, "", fields, token);
+    }
+    else
+    {
+        std::string folded = foldNick(target);
+        size_t matches = 0;
+        for (size_t row = 0; row < _users.size(); ++row)
+        {
+            if (opersOnly && !(_users.flags(row) & USER_OPER))
+                continue;
+            if (!matchMask(folded, _users.nick(row)) && !matchMask(target, _users.user(row))
+                && !matchMask(target, _users.host(row)) && !matchMask(target, _users.realname(row)))
+                continue;
+            if (++matches > _config->whoLimit)
+            {
+                reply << ":localhost 416 " << nickname << " WHO :Too many matches\r\n";
+                break;
+            }
+            reply << whoReply(client, "*", _users.client(row), "", fields, token);
+        }
+    }
+    reply << ":localhost 315 " << nickname << " " << target << " :End of /WHO list\r\n";
+    client->sendMessage(reply.str());
+}
@@ -0,0 +1,267 @@
+#include "Simulation.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#define SIMULATION_EPOCH 1700000000000LL
+
+Simulation::Simulation(unsigned long seed)
+	: _server(NULL), _previous(g_platform), _clock(SIMULATION_EPOCH), _nextFd(FD_SETSIZE), _seed(seed),
+	  _bytesOut(0), _sends(0), _digest(1469598103934665603ULL)
+{
+	g_platform = this;
+
+	Config *config = new Config();
+	config->serverName = "hub.sim";
+	config->linkPassword = "sim";
+	config->snapshotPath = "";
+	config->snapshotInterval = 0;
+	config->corkLatency = 0;
+	_server = new Server(6667, "sim");
+	_server->configure(config);
+}
+
+Simulation::~Simulation()
+{
+	delete _server;
+	g_platform = _previous;
+}
+
+ssize_t Simulation::send(int fd, const char *, size_t length)
+{
+	_bytesOut += length;
+	++_sends;
+	_digest = (_digest ^ static_cast<unsigned long long>(fd)) * 1099511628211ULL;
+	_digest = (_digest ^ length) * 1099511628211ULL;
+	return length;
+}
+
+ssize_t Simulation::recv(int fd, char *buffer, size_t length)
+{
+	std::map<int, std::string>::iterator it = _inbox.find(fd);
+	if (it == _inbox.end() || it->second.empty())
+	{
+		if (_closing.count(fd))
+			return 0;
+		errno = EAGAIN;
+		return -1;
+	}
+	size_t count = std::min(length, it->second.size());
+	std::memcpy(buffer, it->second.data(), count);
+	it->second.erase(0, count);
+	return count;
+}
+
+void Simulation::close(int fd)
+{
+	_inbox.erase(fd);
+	_closing.erase(fd);
+}
+
+long long Simulation::now()
+{
+	return _clock;
+}
+
+int Simulation::connect(bool websocket)
+{
+	int fd = _nextFd++;
+	Listener listener;
+	listener.websocket = websocket;
+	_server->attachClient(fd, websocket ? &listener : NULL);
+	return fd;
+}
+
+void Simulation::input(int fd, const std::string &data)
+{
+	_inbox[fd] += data;
+	while (true)
+	{
+		std::map<int, Client *>::iterator it = _server->_clients.find(fd);
+		std::map<int, std::string>::iterator pending = _inbox.find(fd);
+		if (it == _server->_clients.end() || pending == _inbox.end() || pending->second.empty())
+			break;
+		_server->handleClientData(it->second);
+	}
+}
+
+void Simulation::disconnect(int fd)
+{
+	std::map<int, Client *>::iterator it = _server->_clients.find(fd);
+	if (it == _server->_clients.end())
+		return;
+	_inbox.erase(fd);
+	_closing.insert(fd);
+	_server->handleClientData(it->second);
+}
+
+void Simulation::tick(long long elapsedMs)
+{
+	_clock += elapsedMs;
+	_server->continueLists();
+	_server->flushClients();
+}
+
+bool Simulation::check(std::string &error) const
+{
+	Server &server = *_server;
+	size_t channelSide = 0;
+	for (std::map<std::string, Channel *>::const_iterator it = server._channels.begin(); it != server._channels.end(); ++it)
+	{
+		Channel *channel = it->second;
+		if (channel->getName() != it->first)
+		{
+			error = "channel " + it->first + " is filed under the wrong name";
+			return false;
+		}
+		std::vector<Client *> members = channel->getClients();
+		if (members.empty())
+		{
+			error = "channel " + it->first + " is empty but still indexed";
+			return false;
+		}
+		for (std::vector<Client *>::iterator member = members.begin(); member != members.end(); ++member)
+		{
+			const std::vector<Channel *> &joined = (*member)->getChannels();
+			if (std::find(joined.begin(), joined.end(), channel) == joined.end())
+			{
+				error = (*member)->getNickname() + " is in " + it->first + " but does not list it";
+				return false;
+			}
+		}
+		channelSide += members.size();
+	}
+
+	size_t clientSide = 0;
+	size_t users = 0;
+	size_t monitors = 0;
+	for (std::map<std::string, Client *>::const_iterator it = server._clients_by_nick.begin(); it != server._clients_by_nick.end(); ++it)
+	{
+		Client *client = it->second;
+		if (Server::foldNick(client->getNickname()) != it->first)
+		{
+			error = "nick index entry " + it->first + " points at " + client->getNickname();
+			return false;
+		}
+		if (!client->getUplink())
+		{
+			std::map<int, Client *>::const_iterator local = server._clients.find(client->getFd());
+			if (local == server._clients.end() || local->second != client)
+			{
+				error = "local user " + it->first + " is not in the connection table";
+				return false;
+			}
+		}
+		else
+		{
+			clientSide += client->getChannels().size();
+			if (client->isRegistered())
+				++users;
+		}
+	}
+
+	for (std::map<int, Client *>::const_iterator it = server._clients.begin(); it != server._clients.end(); ++it)
+	{
+		Client *client = it->second;
+		clientSide += client->getChannels().size();
+		monitors += client->_monitoring.size();
+		if (client->isServer() || !client->isRegistered() || client->getNickname().empty())
+			continue;
+		++users;
+		if (server.findClientByNickname(client->getNickname()) != client)
+		{
+			error = "registered user " + client->getNickname() + " is missing from the nick index";
+			return false;
+		}
+		const std::vector<Channel *> &joined = client->getChannels();
+		for (std::vector<Channel *>::const_iterator channel = joined.begin(); channel != joined.end(); ++channel)
+		{
+			std::map<std::string, Channel *>::const_iterator indexed = server._channels.find((*channel)->getName());
+			if (indexed == server._channels.end() || indexed->second != *channel)
+			{
+				error = client->getNickname() + " lists " + (*channel)->getName() + " which is not indexed";
+				return false;
+			}
+		}
+	}
+
+	if (channelSide != clientSide)
+	{
+		error = "channel and client membership counts differ";
+		return false;
+	}
+	if (server._users.size() != users)
+	{
+		error = "user table size does not match registered users";
+		return false;
+	}
+	for (size_t row = 0; row < server._users.size(); ++row)
+	{
+		if (server._users.nick(row) != Server::foldNick(server._users.client(row)->getNickname()))
+		{
+			error = "user table row for " + server._users.client(row)->getNickname() + " is stale";
+			return false;
+		}
+	}
+	if (monitors != server._monitorTotal)
+	{
+		error = "MONITOR total does not match client lists";
+		return false;
+	}
+	return true;
+}
+
+bool Simulation::isConnected(int fd) const
+{
+	return _server->_clients.count(fd) != 0;
+}
+
+Client *Simulation::client(int fd) const
+{
+	std::map<int, Client *>::const_iterator it = _server->_clients.find(fd);
+	return it == _server->_clients.end() ? NULL : it->second;
+}
+
+std::vector<std::string> Simulation::split(const std::string &line, size_t offset) const
+{
+	return _server->splitCommand(line, offset);
+}
+
+bool Simulation::match(const std::string &mask, const std::string &value)
+{
+	return Server::matchMask(mask, value);
+}
+
+size_t Simulation::clients() const
+{
+	return _server->_clients.size();
+}
+
+size_t Simulation::channels() const
+{
+	return _server->_channels.size();
+}
+
+unsigned long Simulation::random()
+{
+	_seed = _seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return static_cast<unsigned long>(_seed >> 33);
+}
+
+unsigned long long Simulation::bytesOut() const
+{
+	return _bytesOut;
+}
+
+unsigned long long Simulation::sends() const
+{
+	return _sends;
+}
+
+unsigned long long Simulation::digest() const
+{
+	return _digest;
+}
@@ -0,0 +1,180 @@
+#include "Simulation.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
+#include "Metrics.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+
+#define SIMULATION_TICK 256
+
+volatile sig_atomic_t g_stop = 0;
+volatile sig_atomic_t g_upgrade = 0;
+volatile sig_atomic_t g_rehash = 0;
+
+static bool g_paranoid = false;
+static size_t g_pending = 0;
+
+static std::string number(unsigned long value)
+{
+    std::ostringstream oss;
+    oss << value;
+    return oss.str();
+}
+
+static void verify(Simulation &sim, const char *phase)
+{
+    std::string error;
+    if (!sim.check(error))
+    {
+        std::fprintf(stderr, "%s: invariant violated: %s\n", phase, error.c_str());
+        std::exit(1);
+    }
+}
+
+static void step(Simulation &sim, const char *phase)
+{
+    sim.tick(1);
+    g_pending = 0;
+    if (g_paranoid)
+        verify(sim, phase);
+}
+
+static void send(Simulation &sim, const char *phase, int fd, const std::string &line)
+{
+    sim.input(fd, line + "\r\n");
+    if (++g_pending >= SIMULATION_TICK)
+        step(sim, phase);
+}
+
+static void report(Simulation &sim, const char *phase, unsigned long long started, unsigned long commands)
+{
+    step(sim, phase);
+    verify(sim, phase);
+    std::printf("%-9s %9lu commands %9.1f ms   clients %7lu  channels %6lu  sends %10llu  bytes %12llu\n",
+                phase, commands, (Metrics::nowUsec() - started) / 1000.0,
+                static_cast<unsigned long>(sim.clients()), static_cast<unsigned long>(sim.channels()),
+                sim.sends(), sim.bytesOut());
+}
+
+static const std::string &pickChannel(Simulation &sim, Client *client)
+{
+    const std::vector<Channel *> &joined = client->getChannels();
+    return joined[sim.random() % joined.size()]->getName();
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long clients = 100000;
+    unsigned long seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-c") == 0)
+            g_paranoid = true;
+        else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = std::strtoul(argv[++i], NULL, 10);
+        else if (std::atol(argv[i]) > 0)
+            clients = std::strtoul(argv[i], NULL, 10);
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [-c] [-s seed] [clients]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout.setstate(std::ios::badbit);
+    Simulation sim(seed);
+    unsigned long channels = clients / 64 + 1;
+    std::vector<int> fds;
+    std::vector<std::string> nicks;
+    unsigned long long started;
+    unsigned long commands;
+
+    started = Metrics::nowUsec();
+    for (unsigned long i = 0; i < clients; ++i)
+    {
+        int fd = sim.connect();
+        fds.push_back(fd);
+        nicks.push_back("u" + number(i));
+        send(sim, "connect", fd, "PASS sim");
+        send(sim, "connect", fd, "NICK " + nicks.back());
+        send(sim, "connect", fd, "USER " + nicks.back() + " 0 * :Simulated user");
+    }
+    report(sim, "connect", started, clients * 3);
+
+    started = Metrics::nowUsec();
+    commands = 0;
+    for (unsigned long i = 0; i < clients; ++i)
+    {
+        for (int j = 0; j < 3; ++j, ++commands)
+            send(sim, "join", fds[i], "JOIN #c" + number(sim.random() % channels));
+    }
+    report(sim, "join", started, commands);
+
+    started = Metrics::nowUsec();
+    commands = 0;
+    for (unsigned long i = 0; i < clients * 2; ++i)
+    {
+        size_t index = sim.random() % fds.size();
+        Client *client = sim.client(fds[index]);
+        if (!client || client->getChannels().empty())
+            continue;
+        send(sim, "flood", fds[index], "PRIVMSG " + pickChannel(sim, client) + " :flood message " + number(i));
+        ++commands;
+    }
+    report(sim, "flood", started, commands);
+
+    started = Metrics::nowUsec();
+    commands = 0;
+    for (unsigned long i = 0; i < clients / 10; ++i, ++commands)
+    {
+        size_t index = sim.random() % fds.size();
+        nicks[index] = "n" + number(i) + "_" + number(index);
+        send(sim, "nick", fds[index], "NICK " + nicks[index]);
+    }
+    report(sim, "nick", started, commands);
+
+    started = Metrics::nowUsec();
+    commands = 0;
+    int link = sim.connect();
+    send(sim, "netsplit", link, "SERVER leaf.sim sim :Simulated leaf");
+    for (unsigned long i = 0; i < clients / 10; ++i, commands += 2)
+    {
+        std::string nickname = (i % 100 == 0) ? nicks[sim.random() % nicks.size()] : "r" + number(i);
+        std::string ts = (i % 200 == 0) ? "1" : number(sim.now() / 1000 + 1);
+        send(sim, "netsplit", link, ":leaf.sim UID " + nickname + " " + ts + " r :Remote user");
+        send(sim, "netsplit", link, ":leaf.sim SJOIN #c" + number(sim.random() % channels) + " + :" + nickname);
+    }
+    send(sim, "netsplit", link, ":leaf.sim EOB");
+    step(sim, "netsplit");
+    verify(sim, "netsplit");
+    sim.disconnect(link);
+    report(sim, "netsplit", started, commands + 2);
+
+    started = Metrics::nowUsec();
+    commands = 0;
+    for (unsigned long i = 0; i < clients; ++i)
+    {
+        Client *client = sim.client(fds[i]);
+        if (!client)
+            continue;
+        if (i % 2 == 0)
+            send(sim, "quit", fds[i], "QUIT :simulated quit");
+        else if (i % 4 == 1 && !client->getChannels().empty())
+            send(sim, "quit", fds[i], "PART " + pickChannel(sim, client));
+        else if (i % 10 == 3)
+        {
+            sim.disconnect(fds[i]);
+            if (++g_pending >= SIMULATION_TICK)
+                step(sim, "quit");
+        }
+        ++commands;
+    }
+    report(sim, "quit", started, commands);
+
+    std::printf("digest %016llx\n", sim.digest());
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "Snapshot.hpp"
+#include <cstring>
+
+SnapshotWriter::SnapshotWriter() : _data(SNAPSHOT_HEADER_SIZE, '\0')
+{
+}
+
+void SnapshotWriter::putU8(uint8_t value)
+{
+	_data += static_cast<char>(value);
+}
+
+void SnapshotWriter::putU32(uint32_t value)
+{
+	for (int shift = 0; shift < 32; shift += 8)
+		_data += static_cast<char>((value >> shift) & 0xff);
+}
+
+void SnapshotWriter::putI32(int32_t value)
+{
+	putU32(static_cast<uint32_t>(value));
+}
+
+void SnapshotWriter::putU64(uint64_t value)
+{
+	putU32(static_cast<uint32_t>(value & 0xffffffffu));
+	putU32(static_cast<uint32_t>(value >> 32));
+}
+
+void SnapshotWriter::putString(const std::string &value)
+{
+	putU32(static_cast<uint32_t>(value.size()));
+	_data += value;
+}
+
+/*
+** Header layout (little endian):
+**   0  magic "IRCSNAP\0"
+**   8  format version
+**  12  reserved
+**  16  payload length
+**  20  payload checksum
+*/
+std::string SnapshotWriter::finish(uint32_t version)
+{
+	const char *payload = _data.data() + SNAPSHOT_HEADER_SIZE;
+	size_t length = _data.size() - SNAPSHOT_HEADER_SIZE;
+	uint32_t fields[4] = {version, 0, static_cast<uint32_t>(length), snapshotChecksum(payload, length)};
+
+	std::memcpy(&_data[0], SNAPSHOT_MAGIC, 8);
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int b = 0; b < 4; ++b)
+			_data[8 + i * 4 + b] = static_cast<char>((fields[i] >> (b * 8)) & 0xff);
+	}
+	return _data;
+}
+
+SnapshotReader::SnapshotReader(const char *data, size_t size) : _data(data), _size(size), _pos(0)
+{
+}
+
+bool SnapshotReader::open(uint32_t version)
+{
+	uint32_t fileVersion;
+	uint32_t reserved;
+	uint32_t length;
+	uint32_t checksum;
+
+	_pos = 0;
+	if (_size < SNAPSHOT_HEADER_SIZE || std::memcmp(_data, SNAPSHOT_MAGIC, 8) != 0)
+		return false;
+	_pos = 8;
+	if (!getU32(fileVersion) || !getU32(reserved) || !getU32(length) || !getU32(checksum))
+		return false;
+	if (fileVersion != version || length != _size - SNAPSHOT_HEADER_SIZE)
+		return false;
+	return snapshotChecksum(_data + SNAPSHOT_HEADER_SIZE, length) == checksum;
+}
+
+bool SnapshotReader::getU8(uint8_t &value)
+{
+	if (_pos + 1 > _size)
+		return false;
+	value = static_cast<uint8_t>(_data[_pos++]);
+	return true;
+}
+
+bool SnapshotReader::getU32(uint32_t &value)
+{
+	if (_pos + 4 > _size)
+		return false;
+	value = 0;
+	for (int b = 0; b < 4; ++b)
+		value |= static_cast<uint32_t>(static_cast<uint8_t>(_data[_pos++])) << (b * 8);
+	return true;
+}
+
+bool SnapshotReader::getI32(int32_t &value)
+{
+	uint32_t raw;
+	if (!getU32(raw))
+		return false;
+	value = static_cast<int32_t>(raw);
+	return true;
+}
+
+bool SnapshotReader::getU64(uint64_t &value)
+{
+	uint32_t low;
+	uint32_t high;
+	if (!getU32(low) || !getU32(high))
+		return false;
+	value = (static_cast<uint64_t>(high) << 32) | low;
+	return true;
+}
+
+bool SnapshotReader::getString(std::string &value)
+{
+	uint32_t length;
+	if (!getU32(length) || length > _size - _pos)
+		return false;
+	value.assign(_data + _pos, length);
+	_pos += length;
+	return true;
+}
+
+bool SnapshotReader::atEnd() const
+{
+	return _pos == _size;
+}
+
+uint32_t snapshotChecksum(const char *data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
@@ -0,0 +1,190 @@
+#include "Tls.hpp"
+#include <iostream>
+
+#ifdef IRCSERV_TLS
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+static SSL_CTX *g_tlsContext = NULL;
+
+bool TlsSession::initialize(const std::string &certificate, const std::string &key)
+{
+	SSL_CTX *context = SSL_CTX_new(TLS_server_method());
+	if (!context)
+		return false;
+
+	SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+	SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_session_id_context(context, reinterpret_cast<const unsigned char *>("ircserv"), 7);
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS);
+#endif
+
+	if (SSL_CTX_use_certificate_chain_file(context, certificate.c_str()) != 1
+		|| SSL_CTX_use_PrivateKey_file(context, key.c_str(), SSL_FILETYPE_PEM) != 1
+		|| SSL_CTX_check_private_key(context) != 1)
+	{
+		char error[256];
+		ERR_error_string_n(ERR_get_error(), error, sizeof(error));
+		std::cerr << "TLS: cannot load " << certificate << " / " << key << ": " << error << std::endl;
+		SSL_CTX_free(context);
+		return false;
+	}
+
+	if (g_tlsContext)
+		SSL_CTX_free(g_tlsContext);
+	g_tlsContext = context;
+	return true;
+}
+
+bool TlsSession::isAvailable()
+{
+	return g_tlsContext != NULL;
+}
+
+TlsSession::TlsSession(int fd) : _ssl(NULL), _wantRead(true), _wantWrite(false), _failed(false)
+{
+	if (!g_tlsContext)
+		return;
+	_ssl = SSL_new(g_tlsContext);
+	if (_ssl && SSL_set_fd(_ssl, fd) == 1)
+		SSL_set_accept_state(_ssl);
+	else
+		_failed = true;
+}
+
+TlsSession::~TlsSession()
+{
+	if (_ssl)
+	{
+		if (!_failed && SSL_is_init_finished(_ssl))
+			SSL_shutdown(_ssl);
+		SSL_free(_ssl);
+	}
+}
+
+bool TlsSession::isKernelOffloaded() const
+{
+	return _ssl && BIO_get_ktls_send(SSL_get_wbio(_ssl));
+}
+
+int TlsSession::update(int result, bool writing)
+{
+	if (writing)
+	{
+		_wantRead = false;
+		_wantWrite = false;
+	}
+	if (result > 0)
+		return result;
+
+	switch (SSL_get_error(_ssl, result))
+	{
+	case SSL_ERROR_WANT_READ:
+		_wantRead = _wantRead || writing;
+		return -1;
+	case SSL_ERROR_WANT_WRITE:
+		_wantWrite = true;
+		return -1;
+	case SSL_ERROR_ZERO_RETURN:
+		return 0;
+	default:
+		ERR_clear_error();
+		_failed = true;
+		return 0;
+	}
+}
+
+ssize_t TlsSession::read(char *buffer, size_t length)
+{
+	if (!_ssl || _failed)
+		return 0;
+	return update(SSL_read(_ssl, buffer, static_cast<int>(length)), false);
+}
+
+ssize_t TlsSession::write(const char *data, size_t length)
+{
+	if (!_ssl || _failed)
+		return -1;
+	int result = update(SSL_write(_ssl, data, static_cast<int>(length)), true);
+	if (result < 0)
+		return 0;
+	return result > 0 ? result : -1;
+}
+
+void TlsSession::handshake()
+{
+	if (_ssl && !_failed && !SSL_is_init_finished(_ssl))
+		update(SSL_do_handshake(_ssl), true);
+	else
+		_wantRead = _wantWrite = false;
+}
+
+#else
+
+bool TlsSession::initialize(const std::string &, const std::string &)
+{
+	std::cerr << "TLS: ircserv was built without TLS support" << std::endl;
+	return false;
+}
+
+bool TlsSession::isAvailable()
+{
+	return false;
+}
+
+TlsSession::TlsSession(int) : _ssl(NULL), _wantRead(false), _wantWrite(false), _failed(true)
+{
+}
+
+TlsSession::~TlsSession()
+{
+}
+
+bool TlsSession::isKernelOffloaded() const
+{
+	return false;
+}
+
+int TlsSession::update(int result, bool)
+{
+	return result;
+}
+
+ssize_t TlsSession::read(char *, size_t)
+{
+	return 0;
+}
+
+ssize_t TlsSession::write(const char *, size_t)
+{
+	return -1;
+}
+
+void TlsSession::handshake()
+{
+}
+
+#endif
+
+bool TlsSession::isValid() const
+{
+	return _ssl != NULL && !_failed;
+}
+
+bool TlsSession::hasFailed() const
+{
+	return _failed;
+}
+
+bool TlsSession::wantsRead() const
+{
+	return _wantRead;
+}
+
+bool TlsSession::wantsWrite() const
+{
+	return _wantWrite;
+}
@@ -0,0 +1,205 @@
+#include "Trace.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+TraceWriter::TraceWriter() : _fd(-1), _last(0), _flushed(0)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+	close();
+}
+
+/*
+** Every open appends a header (little endian):
+**   0  magic "IRCTRACE"
+**   8  format version
+**   9  start time in milliseconds
+** followed by records:
+**   event, varint connection, varint milliseconds since the previous record
+**   and, for TRACE_LINE, varint length and the line without CRLF.
+*/
+bool TraceWriter::open(const std::string &path, long long now)
+{
+	close();
+	_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (_fd < 0)
+		return false;
+	fcntl(_fd, F_SETFD, FD_CLOEXEC);
+	_path = path;
+	_buffer.assign(TRACE_MAGIC, 8);
+	_buffer += static_cast<char>(TRACE_VERSION);
+	for (int shift = 0; shift < 64; shift += 8)
+		_buffer += static_cast<char>((static_cast<uint64_t>(now) >> shift) & 0xff);
+	_last = now;
+	_flushed = now;
+	return true;
+}
+
+void TraceWriter::close()
+{
+	if (_fd < 0)
+		return;
+	write();
+	::close(_fd);
+	_fd = -1;
+	_path.clear();
+}
+
+bool TraceWriter::isOpen() const
+{
+	return _fd >= 0;
+}
+
+const std::string &TraceWriter::path() const
+{
+	return _path;
+}
+
+void TraceWriter::record(uint8_t event, int connection, long long time, const std::string &line)
+{
+	if (_fd < 0)
+		return;
+	_buffer += static_cast<char>(event);
+	putVarint(static_cast<uint32_t>(connection));
+	putVarint(time > _last ? time - _last : 0);
+	if (time > _last)
+		_last = time;
+	if (event == TRACE_LINE)
+	{
+		putVarint(line.size());
+		_buffer += line;
+	}
+	if (_buffer.size() >= TRACE_BUFFER)
+		write();
+}
+
+void TraceWriter::flush(long long now)
+{
+	if (_fd < 0 || _buffer.empty() || now - _flushed < TRACE_FLUSH_INTERVAL)
+		return;
+	write();
+	_flushed = now;
+}
+
+void TraceWriter::putVarint(uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		_buffer += static_cast<char>((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	_buffer += static_cast<char>(value);
+}
+
+void TraceWriter::write()
+{
+	size_t written = 0;
+	while (written < _buffer.size())
+	{
+		ssize_t n = ::write(_fd, _buffer.data() + written, _buffer.size() - written);
+		if (n <= 0)
+			break;
+		written += n;
+	}
+	_buffer.clear();
+}
+
+TraceReader::TraceReader() : _pos(0), _last(0), _failed(false)
+{
+}
+
+bool TraceReader::open(const std::string &path, std::string &error)
+{
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in)
+	{
+		error = "cannot open " + path;
+		return false;
+	}
+	std::ostringstream contents;
+	contents << in.rdbuf();
+	_data = contents.str();
+	_pos = 0;
+	_failed = false;
+	if (!readHeader())
+	{
+		error = path + " is not a trace";
+		return false;
+	}
+	return true;
+}
+
+bool TraceReader::next(TraceRecord &record)
+{
+	while (_pos < _data.size() && _data[_pos] == TRACE_MAGIC[0])
+	{
+		if (!readHeader())
+		{
+			_failed = true;
+			return false;
+		}
+	}
+	if (_pos >= _data.size())
+		return false;
+
+	uint64_t connection;
+	uint64_t delta;
+	record.event = static_cast<uint8_t>(_data[_pos++]);
+	if (record.event < TRACE_OPEN || record.event > TRACE_CLOSE || !getVarint(connection) || !getVarint(delta))
+	{
+		_failed = true;
+		return false;
+	}
+	record.connection = static_cast<uint32_t>(connection);
+	_last += delta;
+	record.time = _last;
+	record.line.clear();
+	if (record.event == TRACE_LINE)
+	{
+		uint64_t length;
+		if (!getVarint(length) || length > _data.size() - _pos)
+		{
+			_failed = true;
+			return false;
+		}
+		record.line.assign(_data, _pos, length);
+		_pos += length;
+	}
+	return true;
+}
+
+bool TraceReader::failed() const
+{
+	return _failed;
+}
+
+bool TraceReader::getVarint(uint64_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && _pos < _data.size(); shift += 7)
+	{
+		unsigned char byte = static_cast<unsigned char>(_data[_pos++]);
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool TraceReader::readHeader()
+{
+	if (_data.size() - _pos < TRACE_HEADER_SIZE || std::memcmp(_data.data() + _pos, TRACE_MAGIC, 8) != 0
+		|| static_cast<unsigned char>(_data[_pos + 8]) != TRACE_VERSION)
+		return false;
+	uint64_t start = 0;
+	for (int i = 0; i < 8; ++i)
+		start |= static_cast<uint64_t>(static_cast<unsigned char>(_data[_pos + 9 + i])) << (8 * i);
+	_last = static_cast<long long>(start);
+	_pos += TRACE_HEADER_SIZE;
+	return true;
+}
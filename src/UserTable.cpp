@@ -0,0 +1,107 @@
+#include "UserTable.hpp"
+#include "Client.hpp"
+
+void UserTable::insert(Client *client, const std::string &folded, unsigned char flags)
+{
+	if (_rows.count(client))
+	{
+		rename(client, folded);
+		setFlags(client, flags);
+		return;
+	}
+
+	_rows[client] = _clients.size();
+	_clients.push_back(client);
+	_nicks.push_back(folded);
+	_users.push_back(client->getUsername().empty() ? "user" : client->getUsername());
+	_hosts.push_back("localhost");
+	_realnames.push_back(client->getRealname());
+	_flags.push_back(flags);
+}
+
+void UserTable::rename(Client *client, const std::string &folded)
+{
+	std::map<Client *, size_t>::iterator it = _rows.find(client);
+	if (it != _rows.end())
+		_nicks[it->second] = folded;
+}
+
+void UserTable::setFlags(Client *client, unsigned char flags)
+{
+	std::map<Client *, size_t>::iterator it = _rows.find(client);
+	if (it != _rows.end())
+		_flags[it->second] = flags;
+}
+
+void UserTable::remove(Client *client)
+{
+	std::map<Client *, size_t>::iterator it = _rows.find(client);
+	if (it == _rows.end())
+		return;
+
+	size_t row = it->second;
+	size_t last = _clients.size() - 1;
+	_rows.erase(it);
+	if (row != last)
+	{
+		_clients[row] = _clients[last];
+		_nicks[row].swap(_nicks[last]);
+		_users[row].swap(_users[last]);
+		_hosts[row].swap(_hosts[last]);
+		_realnames[row].swap(_realnames[last]);
+		_flags[row] = _flags[last];
+		_rows[_clients[row]] = row;
+	}
+	_clients.pop_back();
+	_nicks.pop_back();
+	_users.pop_back();
+	_hosts.pop_back();
+	_realnames.pop_back();
+	_flags.pop_back();
+}
+
+void UserTable::clear()
+{
+	_clients.clear();
+	_nicks.clear();
+	_users.clear();
+	_hosts.clear();
+	_realnames.clear();
+	_flags.clear();
+	_rows.clear();
+}
+
+size_t UserTable::size() const
+{
+	return _clients.size();
+}
+
+Client *UserTable::client(size_t row) const
+{
+	return _clients[row];
+}
+
+const std::string &UserTable::nick(size_t row) const
+{
+	return _nicks[row];
+}
+
+const std::string &UserTable::user(size_t row) const
+{
+	return _users[row];
+}
+
+const std::string &UserTable::host(size_t row) const
+{
+	return _hosts[row];
+}
+
+const std::string &UserTable::realname(size_t row) const
+{
+	return _realnames[row];
+}
+
+unsigned char UserTable::flags(size_t row) const
+{
+	return _flags[row];
+}
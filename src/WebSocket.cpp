@@ -0,0 +1,365 @@
+#include "WebSocket.hpp"
+#include "Snapshot.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+
+static const char *WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const char *WEBSOCKET_PROTOCOL = "text.ircv3.net";
+
+static uint32_t rotate(uint32_t value, int bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+static std::string sha1(const std::string &input)
+{
+	uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+	std::string data = input;
+	uint64_t bits = static_cast<uint64_t>(input.size()) * 8;
+	data += static_cast<char>(0x80);
+	while (data.size() % 64 != 56)
+		data += '\0';
+	for (int i = 7; i >= 0; --i)
+		data += static_cast<char>((bits >> (i * 8)) & 0xff);
+
+	for (size_t chunk = 0; chunk < data.size(); chunk += 64)
+	{
+		uint32_t w[80];
+		for (int i = 0; i < 16; ++i)
+		{
+			const unsigned char *p = reinterpret_cast<const unsigned char *>(data.data() + chunk + i * 4);
+			w[i] = (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+		}
+		for (int i = 16; i < 80; ++i)
+			w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (int i = 0; i < 80; ++i)
+		{
+			uint32_t f, k;
+			if (i < 20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			uint32_t t = rotate(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rotate(b, 30);
+			b = a;
+			a = t;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	std::string digest;
+	for (int i = 0; i < 5; ++i)
+		for (int shift = 24; shift >= 0; shift -= 8)
+			digest += static_cast<char>((h[i] >> shift) & 0xff);
+	return digest;
+}
+
+static std::string base64(const std::string &input)
+{
+	static const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string output;
+	for (size_t i = 0; i < input.size(); i += 3)
+	{
+		uint32_t chunk = static_cast<unsigned char>(input[i]) << 16;
+		if (i + 1 < input.size())
+			chunk |= static_cast<unsigned char>(input[i + 1]) << 8;
+		if (i + 2 < input.size())
+			chunk |= static_cast<unsigned char>(input[i + 2]);
+		output += alphabet[(chunk >> 18) & 63];
+		output += alphabet[(chunk >> 12) & 63];
+		output += i + 1 < input.size() ? alphabet[(chunk >> 6) & 63] : '=';
+		output += i + 2 < input.size() ? alphabet[chunk & 63] : '=';
+	}
+	return output;
+}
+
+static std::string lowercase(std::string value)
+{
+	for (size_t i = 0; i < value.size(); ++i)
+		value[i] = std::tolower(static_cast<unsigned char>(value[i]));
+	return value;
+}
+
+static std::string trim(const std::string &value)
+{
+	size_t start = value.find_first_not_of(" \t");
+	if (start == std::string::npos)
+		return "";
+	return value.substr(start, value.find_last_not_of(" \t") - start + 1);
+}
+
+static bool hasToken(const std::string &list, const std::string &token)
+{
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		if (lowercase(trim(item)) == token)
+			return true;
+	}
+	return false;
+}
+
+WebSocket::WebSocket() : _open(false), _fragmented(false)
+{
+}
+
+bool WebSocket::isOpen() const
+{
+	return _open;
+}
+
+bool WebSocket::receive(const std::string &data, std::string &lines, std::string &reply)
+{
+	_input += data;
+	if (!_open && !upgrade(reply))
+		return false;
+	if (!_open)
+		return true;
+	if (decode(lines, reply))
+		return true;
+	_open = false;
+	return false;
+}
+
+bool WebSocket::upgrade(std::string &reply)
+{
+	size_t end = _input.find("\r\n\r\n");
+	if (end == std::string::npos)
+	{
+		if (_input.size() <= WEBSOCKET_HANDSHAKE_LIMIT)
+			return true;
+		reply = "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+		return false;
+	}
+
+	std::stringstream ss(_input.substr(0, end));
+	_input.erase(0, end + 4);
+
+	std::string line;
+	std::getline(ss, line);
+	std::string upgradeHeader, connection, key, version, protocols;
+	bool valid = line.compare(0, 4, "GET ") == 0;
+	while (std::getline(ss, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string name = lowercase(trim(line.substr(0, colon)));
+		std::string value = trim(line.substr(colon + 1));
+		if (name == "upgrade")
+			upgradeHeader = value;
+		else if (name == "connection")
+			connection = value;
+		else if (name == "sec-websocket-key")
+			key = value;
+		else if (name == "sec-websocket-version")
+			version = value;
+		else if (name == "sec-websocket-protocol")
+			protocols += (protocols.empty() ? "" : ",") + value;
+	}
+
+	if (!valid || !hasToken(upgradeHeader, "websocket") || !hasToken(connection, "upgrade") || key.empty())
+	{
+		reply = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+		return false;
+	}
+	if (version != "13")
+	{
+		reply = "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+		return false;
+	}
+
+	reply = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + accept(key) + "\r\n";
+	if (hasToken(protocols, WEBSOCKET_PROTOCOL))
+		reply += std::string("Sec-WebSocket-Protocol: ") + WEBSOCKET_PROTOCOL + "\r\n";
+	reply += "\r\n";
+	_open = true;
+	return true;
+}
+
+bool WebSocket::decode(std::string &lines, std::string &reply)
+{
+	while (_input.size() >= 2)
+	{
+		const unsigned char *bytes = reinterpret_cast<const unsigned char *>(_input.data());
+		bool fin = bytes[0] & 0x80;
+		unsigned char opcode = bytes[0] & 0x0f;
+		uint64_t length = bytes[1] & 0x7f;
+		size_t offset = 2;
+
+		if ((bytes[0] & 0x70) || !(bytes[1] & 0x80))
+		{
+			reply += closeFrame(1002);
+			return false;
+		}
+		if (length == 126)
+		{
+			if (_input.size() < 4)
+				return true;
+			length = (bytes[2] << 8) | bytes[3];
+			offset = 4;
+		}
+		else if (length == 127)
+		{
+			if (_input.size() < 10)
+				return true;
+			length = 0;
+			for (int i = 2; i < 10; ++i)
+				length = (length << 8) | bytes[i];
+			offset = 10;
+		}
+		if ((opcode & 0x08) && (length > 125 || !fin))
+		{
+			reply += closeFrame(1002);
+			return false;
+		}
+		if (length > WEBSOCKET_MESSAGE_LIMIT || (!(opcode & 0x08) && length + _message.size() > WEBSOCKET_MESSAGE_LIMIT))
+		{
+			reply += closeFrame(1009);
+			return false;
+		}
+		if (_input.size() < offset + 4 + length)
+			return true;
+
+		const unsigned char *mask = bytes + offset;
+		std::string payload(_input, offset + 4, length);
+		for (size_t i = 0; i < payload.size(); ++i)
+			payload[i] ^= mask[i % 4];
+		_input.erase(0, offset + 4 + length);
+
+		switch (opcode)
+		{
+		case 0x0:
+		case 0x1:
+		case 0x2:
+			if ((opcode == 0x0) != _fragmented)
+			{
+				reply += closeFrame(1002);
+				return false;
+			}
+			_message += payload;
+			_fragmented = !fin;
+			if (fin)
+			{
+				while (!_message.empty() && (_message[_message.size() - 1] == '\n' || _message[_message.size() - 1] == '\r'))
+					_message.erase(_message.size() - 1);
+				lines += _message + "\r\n";
+				_message.clear();
+			}
+			break;
+		case 0x8:
+			reply += header(0x8, std::min<size_t>(payload.size(), 2)) + payload.substr(0, 2);
+			return false;
+		case 0x9:
+			reply += header(0xA, payload.size()) + payload;
+			break;
+		case 0xA:
+			break;
+		default:
+			reply += closeFrame(1002);
+			return false;
+		}
+	}
+	return true;
+}
+
+std::string WebSocket::header(unsigned char opcode, size_t length)
+{
+	std::string header(1, static_cast<char>(0x80 | opcode));
+	if (length < 126)
+		header += static_cast<char>(length);
+	else if (length <= 0xffff)
+	{
+		header += static_cast<char>(126);
+		header += static_cast<char>((length >> 8) & 0xff);
+		header += static_cast<char>(length & 0xff);
+	}
+	else
+	{
+		header += static_cast<char>(127);
+		for (int shift = 56; shift >= 0; shift -= 8)
+			header += static_cast<char>((static_cast<uint64_t>(length) >> shift) & 0xff);
+	}
+	return header;
+}
+
+std::string WebSocket::frame(const std::string &message)
+{
+	std::string frames;
+	size_t start = 0;
+	while (start < message.size())
+	{
+		size_t end = message.find("\r\n", start);
+		size_t next = (end == std::string::npos) ? message.size() : end + 2;
+		if (end == std::string::npos)
+			end = message.size();
+		if (end > start)
+		{
+			frames += header(0x1, end - start);
+			frames.append(message, start, end - start);
+		}
+		start = next;
+	}
+	return frames;
+}
+
+std::string WebSocket::closeFrame(unsigned short code)
+{
+	std::string frame = header(0x8, 2);
+	frame += static_cast<char>((code >> 8) & 0xff);
+	frame += static_cast<char>(code & 0xff);
+	return frame;
+}
+
+std::string WebSocket::accept(const std::string &key)
+{
+	return base64(sha1(key + WEBSOCKET_GUID));
+}
+
+void WebSocket::save(SnapshotWriter &writer) const
+{
+	writer.putU8((_open ? 1 : 0) | (_fragmented ? 2 : 0));
+	writer.putString(_input);
+	writer.putString(_message);
+}
+
+bool WebSocket::restore(SnapshotReader &reader)
+{
+	uint8_t flags;
+	if (!reader.getU8(flags) || !reader.getString(_input) || !reader.getString(_message))
+		return false;
+	_open = flags & 1;
+	_fragmented = flags & 2;
+	return true;
+}
@@ -1,20 +1,102 @@
 #include <iostream>
 #include <cstdlib>
+#include <climits>
+#include <string>
+#include <sstream>
+#include <unistd.h>
 #include "Server.hpp"
+#include "FanoutPool.hpp"
 
 volatile sig_atomic_t g_stop = 0;
+volatile sig_atomic_t g_upgrade = 0;
+volatile sig_atomic_t g_rehash = 0;
 
 void HandleSigint(int)
 {
     g_stop = 1;
 }
 
+void HandleSigusr2(int)
+{
+    g_upgrade = 1;
+}
+
+void HandleSighup(int)
+{
+    g_rehash = 1;
+}
+
+static Config *LoadConfig(const char *path)
+{
+    Config *config = new Config();
+    config->applyEnvironment();
+    std::string error;
+    if (path && !config->load(path, error))
+    {
+        std::cerr << "Configuration error: " << error << std::endl;
+        delete config;
+        return NULL;
+    }
+    return config;
+}
+
+static bool Configure(Server &server, const char *path)
+{
+    Config *config = LoadConfig(path);
+    if (!config)
+        return false;
+    if (config->fanoutThreads > 0)
+        g_fanout.start(config->fanoutThreads);
+    server.configure(config);
+    return true;
+}
+
+static std::string BinaryPath(const char *argv0)
+{
+    char resolved[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", resolved, sizeof(resolved) - 1);
+    if (length > 0)
+        return std::string(resolved, length);
+
+    std::string name = argv0;
+    const char *path = std::getenv("PATH");
+    if (name.find('/') == std::string::npos && path)
+    {
+        std::stringstream dirs(path);
+        std::string dir;
+        while (std::getline(dirs, dir, ':'))
+        {
+            std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+            if (access(candidate.c_str(), X_OK) == 0)
+            {
+                name = candidate;
+                break;
+            }
+        }
+    }
+    if (realpath(name.c_str(), resolved))
+        return resolved;
+    return name;
+}
+
 int main(int argc, char *argv[])
 {
     signal(SIGINT, HandleSigint);
-    if (argc != 3)
+    signal(SIGTERM, HandleSigint);
+    signal(SIGUSR2, HandleSigusr2);
+    signal(SIGHUP, HandleSighup);
+    if ((argc == 3 || argc == 4) && std::string(argv[1]) == "--upgrade")
+    {
+        Server server(0, "");
+        server.setBinaryPath(BinaryPath(argv[0]));
+        if (!Configure(server, argc == 4 ? argv[3] : NULL))
+            return 1;
+        server.resume(std::atoi(argv[2]));
+        return 0;
+    }
+    if (argc != 3 && argc != 4)
     {
-        std::cerr << "Usage: " << argv[0] << " <port> <password>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <port> <password> [config]" << std::endl;
         return 1;
     }
     if(argv[2][0] == '\0')
@@ -37,6 +119,9 @@ int main(int argc, char *argv[])
         return 1;
     }
     Server server(port, argv[2]);
+    server.setBinaryPath(BinaryPath(argv[0]));
+    if (!Configure(server, argc == 4 ? argv[3] : NULL))
+        return 1;
     server.run();
     return 0;
 }